@@ -0,0 +1,21 @@
+#include "airsynth.h"
+
+void air_synth_init(air_synth_t *s, uint8_t step){
+	s->pos = 0;
+	s->step = (step == 0 || step > AIR_SYNTH_BEAMS) ? 1 : step;
+}
+
+uint8_t air_synth_poll(air_synth_t *s, uint8_t raw){
+	uint8_t target = 0;
+	raw &= (1 << AIR_SYNTH_BEAMS) - 1;
+	// 目标高度为最高被遮挡光束的位置
+	while(raw >> target){
+		target++;
+	}
+	if(target > s->pos){
+		s->pos = target - s->pos > s->step ? s->pos + s->step : target;
+	}else if(target < s->pos){
+		s->pos = s->pos - target > s->step ? s->pos - s->step : target;
+	}
+	return (uint8_t)((1 << s->pos) - 1);
+}
@@ -0,0 +1,23 @@
+#ifndef AIRSYNTH_H
+#define AIRSYNTH_H
+#include <stdint.h>
+
+// 天键手势合成：游戏要求六条红外光束像手一样逐条被遮挡，一帧内整排同时遮挡会被判为miss。
+// 手台上报的天键状态（可能只有“按下/松开”两种）先换算成目标高度（最高被遮挡光束的位置），
+// 每次游戏调用chuni_io_jvs_poll时手的高度最多向目标移动step条光束。
+// 按游戏的轮询而不是按时间推进，边沿之后的第一次轮询就会开始抬手，没有额外的定时等待；
+// 本身已经逐条上报的固件只要每次变化不超过step，输出与输入相同。
+
+#define AIR_SYNTH_BEAMS 6
+
+typedef struct air_synth {
+	uint8_t pos;  // 当前手的高度，0为没有遮挡，6为全部遮挡
+	uint8_t step; // 每次轮询最多移动的光束数
+} air_synth_t;
+
+void air_synth_init(air_synth_t *s, uint8_t step);
+
+// 每次游戏轮询调用一次，raw为手台上报的光束状态，返回交给游戏的光束状态
+uint8_t air_synth_poll(air_synth_t *s, uint8_t raw);
+
+#endif
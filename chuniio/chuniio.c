@@ -5,7 +5,9 @@
 #include <stdint.h>
 
 #include "chuniio.h"
+#include "airsynth.h"
 #include "config.h"
+#include "holddec.h"
 #include "serialslider.h"
 
 uint8_t Air_key_Status;
@@ -23,13 +25,49 @@ static bool chuni_io_coin;
 static uint16_t chuni_io_coins;
 static uint8_t chuni_io_hand_pos;
 static HANDLE chuni_io_slider_thread;
-static bool chuni_io_slider_stop_flag;
+static volatile bool chuni_io_slider_stop_flag;
+
+/* The slider thread is created on the first start and parked on stop
+   rather than torn down, so operator menu cycles don't create threads or
+   allocate. run is set while the slider is started, parked while the
+   thread is waiting for it. */
+static HANDLE chuni_io_slider_run;
+static HANDLE chuni_io_slider_parked;
 static struct chuni_io_config chuni_io_cfg;
+static air_synth_t chuni_io_air;
+
+/* Callbacks are only delivered between slider_start and slider_stop. The
+   lock makes sure no callback is still running once slider_stop returns. */
+static SRWLOCK chuni_io_slider_gate = SRWLOCK_INIT;
+static chuni_io_slider_callback_t chuni_io_slider_callback;
+static bool chuni_io_slider_active;
+
+/* Latest frame for chuni_io_ext_get_slider. Only the slider thread writes
+   it; lock is odd while it does. */
+static volatile LONG chuni_io_ext_lock;
+static struct chuni_io_ext_slider chuni_io_ext;
+
+static struct cadence_stats chuni_io_cadence[CHUNI_IO_API_COUNT];
 
-typedef struct {
-    chuni_io_slider_callback_t callback;
-    Queue* queue;
-} callback_context;
+/* Operator buttons. Firmware that appends an io_status byte to the scan
+   frame reports them with the same bits as mai2. The slider thread latches
+   every bit it sees until the next poll, so a press shorter than a poll
+   isn't lost, and counts coin edges itself. The keyboard is sampled once
+   per jvs_poll into chuni_io_keys and can be turned off with
+   [io3] keyboard=0. */
+#define CHUNI_IO_IO_TEST 0x01
+#define CHUNI_IO_IO_SERVICE 0x02
+#define CHUNI_IO_IO_COIN 0x04
+
+static volatile LONG chuni_io_board_io;
+static volatile LONG chuni_io_board_latch;
+static volatile LONG chuni_io_board_coins;
+static uint8_t chuni_io_keys;
+
+/* [slider] maxRate: frames between deliveries are folded, pressed bits by
+   holddec.h and pressure max-held here. Only the slider thread uses it. */
+static struct hold_decimator chuni_io_slider_hold;
+static uint8_t chuni_io_slider_max[32];
 
 uint16_t chuni_io_get_api_version(void)
 {
@@ -38,45 +76,84 @@ uint16_t chuni_io_get_api_version(void)
 
 HRESULT chuni_io_jvs_init(void)
 {
+    LARGE_INTEGER freq;
+
     chuni_io_config_load(&chuni_io_cfg, L".\\segatools.ini");
+    air_synth_init(&chuni_io_air, chuni_io_cfg.air_synth_step);
+
+    QueryPerformanceFrequency(&freq);
+    hold_init(&chuni_io_slider_hold, chuni_io_cfg.max_rate ? freq.QuadPart / chuni_io_cfg.max_rate : 0);
 
     return S_OK;
 }
 
 void chuni_io_jvs_read_coin_counter(uint16_t *out)
 {
+    int64_t entered;
+
     if (out == NULL) {
         return;
     }
 
-    if (GetAsyncKeyState(chuni_io_cfg.vk_coin)) {
-        if (!chuni_io_coin) {
-            chuni_io_coin = true;
-            chuni_io_coins++;
-        }
-    } else {
-        chuni_io_coin = false;
-    }
+    entered = cadence_enter(&chuni_io_cadence[CHUNI_IO_API_JVS_READ_COIN_COUNTER], chuni_io_cfg.cadence_gap * 1000);
 
-    *out = chuni_io_coins;
+    *out = chuni_io_coins + (uint16_t) chuni_io_board_coins;
+    cadence_leave(&chuni_io_cadence[CHUNI_IO_API_JVS_READ_COIN_COUNTER], entered);
 }
 
 void chuni_io_jvs_poll(uint8_t *opbtn, uint8_t *beams)
 {
-    size_t i;
+    int64_t entered = cadence_enter(&chuni_io_cadence[CHUNI_IO_API_JVS_POLL], chuni_io_cfg.cadence_gap * 1000);
+    uint8_t board;
+
+    board = (uint8_t) InterlockedExchange(&chuni_io_board_latch, chuni_io_board_io);
+
+    if (chuni_io_cfg.keyboard) {
+        chuni_io_keys = 0;
+
+        if (GetAsyncKeyState(chuni_io_cfg.vk_test)) {
+            chuni_io_keys |= CHUNI_IO_IO_TEST;
+        }
+
+        if (GetAsyncKeyState(chuni_io_cfg.vk_service)) {
+            chuni_io_keys |= CHUNI_IO_IO_SERVICE;
+        }
+
+        if (GetAsyncKeyState(chuni_io_cfg.vk_coin)) {
+            if (!chuni_io_coin) {
+                chuni_io_coin = true;
+                chuni_io_coins++;
+            }
+        } else {
+            chuni_io_coin = false;
+        }
+    }
 
-    if (GetAsyncKeyState(chuni_io_cfg.vk_test)) {
+    if ((board | chuni_io_keys) & CHUNI_IO_IO_TEST) {
         *opbtn |= 0x01; /* Test */
     }
 
-    if (GetAsyncKeyState(chuni_io_cfg.vk_service)) {
+    if ((board | chuni_io_keys) & CHUNI_IO_IO_SERVICE) {
         *opbtn |= 0x02; /* Service */
     }
-    *beams = Air_key_Status;
+    if (chuni_io_cfg.air_synth) {
+        *beams = air_synth_poll(&chuni_io_air, Air_key_Status);
+    } else {
+        *beams = Air_key_Status;
+    }
+    cadence_leave(&chuni_io_cadence[CHUNI_IO_API_JVS_POLL], entered);
 }
 
 HRESULT chuni_io_slider_init(void)
 {
+    struct serial_tune tune;
+
+    // 串口驱动参数：内置默认值，可由[serial.VID_AFF1&PID_52A4]覆盖
+    slider_get_tune(&tune);
+    serial_tune_load(&tune, vid, pid, L".\\segatools.ini");
+    slider_set_tune(&tune);
+    serial_tune_latency(vid, pid, tune.latency_timer);
+
 	// Open ports
     memcpy(comPort,GetSerialPortByVidPid(vid,pid),6);
 
@@ -92,6 +169,10 @@ HRESULT chuni_io_slider_init(void)
         snprintf(comPort, 11, "\\\\.\\COM%d", port_num);
         
     }
+    slider_set_liveness_timeout(chuni_io_cfg.liveness_timeout);
+    if (!slider_queue_init()) {
+        return E_FAIL;
+    }
     open_port();
     return S_OK;
 }
@@ -99,40 +180,59 @@ HRESULT chuni_io_slider_init(void)
 
 void chuni_io_slider_start(chuni_io_slider_callback_t callback)
 {
-    Sleep(1);
+    AcquireSRWLockExclusive(&chuni_io_slider_gate);
+    chuni_io_slider_callback = callback;
+    chuni_io_slider_active = true;
+    ReleaseSRWLockExclusive(&chuni_io_slider_gate);
+
+    /* With keepWarm the board never stopped scanning */
+    if (chuni_io_cfg.keep_warm && chuni_io_slider_thread != NULL) {
+        return;
+    }
+
     slider_start_air_scan();
     slider_start_scan();
     if (chuni_io_slider_thread != NULL) {
+        /* Clear parked before the thread is released, not after it wakes,
+           or a stop right after this start could see the old signal and
+           return while the thread is still reading */
+        ResetEvent(chuni_io_slider_parked);
+        chuni_io_slider_stop_flag = false;
+        SetEvent(chuni_io_slider_run);
         return;
     }
 
-    InitializeCriticalSection(&cs);
-    Queue* queue = createQueue(100);
-    callback_context* ctx = (callback_context*)malloc(sizeof(callback_context));
-    ctx->callback = callback;
-    ctx->queue = queue;
-    // CreateThread(NULL, 0, sliderserial_read_thread, queue, 0, NULL);
-    chuni_io_slider_thread = (HANDLE) _beginthreadex(NULL,0,chuni_io_slider_thread_proc,ctx,0,NULL);
+    chuni_io_slider_run = CreateEvent(NULL, TRUE, TRUE, NULL);
+    chuni_io_slider_parked = CreateEvent(NULL, TRUE, FALSE, NULL);
+    chuni_io_slider_thread = (HANDLE) _beginthreadex(NULL,0,chuni_io_slider_thread_proc,NULL,0,NULL);
 }
 
 void chuni_io_slider_stop(void)
 {
+    AcquireSRWLockExclusive(&chuni_io_slider_gate);
+    chuni_io_slider_active = false;
+    ReleaseSRWLockExclusive(&chuni_io_slider_gate);
+
+    if (chuni_io_cfg.keep_warm) {
+        return;
+    }
+
     slider_stop_scan();
 
-    if (chuni_io_slider_thread == NULL) {
+    if (chuni_io_slider_thread == NULL || chuni_io_slider_stop_flag) {
         return;
     }
 
+    ResetEvent(chuni_io_slider_run);
     chuni_io_slider_stop_flag = true;
 
-    WaitForSingleObject(chuni_io_slider_thread, INFINITE);
-    CloseHandle(chuni_io_slider_thread);
-    chuni_io_slider_thread = NULL;
-    chuni_io_slider_stop_flag = false;
+    WaitForSingleObject(chuni_io_slider_parked, INFINITE);
 }
 
 void chuni_io_slider_set_leds(const uint8_t *rgb)
 {
+    int64_t entered = cadence_enter(&chuni_io_cadence[CHUNI_IO_API_SLIDER_SET_LEDS], chuni_io_cfg.cadence_gap * 1000);
+
     LED_status = 0;
     for(uint8_t i =0;i<sizeof(rgb);i++){
         if(rgb[i] != 0){
@@ -141,10 +241,12 @@ void chuni_io_slider_set_leds(const uint8_t *rgb)
         }
     }
     slider_send_leds(rgb);
+    cadence_leave(&chuni_io_cadence[CHUNI_IO_API_SLIDER_SET_LEDS], entered);
 }
 
 void chuni_io_led_set_colors(uint8_t board,uint8_t *rgb_raw)
 {
+    int64_t entered = cadence_enter(&chuni_io_cadence[CHUNI_IO_API_LED_SET_COLORS], chuni_io_cfg.cadence_gap * 1000);
     uint8_t air_rgb[3];
     if(board == 0){
         air_rgb[0] = rgb_raw[152];
@@ -154,6 +256,7 @@ void chuni_io_led_set_colors(uint8_t board,uint8_t *rgb_raw)
         slider_send_air_leds(air_rgb);
         //dprintf("AffineIO:Air LED%02x,%02x,%02x",rgb_raw[150],rgb_raw[150+1],rgb_raw[150+2]);
     }
+    cadence_leave(&chuni_io_cadence[CHUNI_IO_API_LED_SET_COLORS], entered);
 }
 
 HRESULT chuni_io_led_init(void)
@@ -161,34 +264,225 @@ HRESULT chuni_io_led_init(void)
     return S_OK;
 }
 
+static void chuni_io_board_status(uint8_t io)
+{
+    LONG last = InterlockedExchange(&chuni_io_board_io, io);
+
+    InterlockedOr(&chuni_io_board_latch, io);
+
+    if ((io & CHUNI_IO_IO_COIN) && !(last & CHUNI_IO_IO_COIN)) {
+        InterlockedIncrement(&chuni_io_board_coins);
+    }
+}
+
+static int64_t chuni_io_qpc(void)
+{
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+/* Returns the time the game got the frame, 0 if it didn't */
+
+static int64_t chuni_io_slider_deliver(const uint8_t *pressure)
+{
+    int64_t delivered = 0;
+
+    AcquireSRWLockShared(&chuni_io_slider_gate);
+    if (chuni_io_slider_active) {
+        delivered = cadence_enter(&chuni_io_cadence[CHUNI_IO_API_SLIDER_CALLBACK], chuni_io_cfg.cadence_gap * 1000);
+        chuni_io_slider_callback(pressure);
+        cadence_leave(&chuni_io_cadence[CHUNI_IO_API_SLIDER_CALLBACK], delivered);
+    }
+    ReleaseSRWLockShared(&chuni_io_slider_gate);
+
+    return delivered;
+}
+
+static uint64_t chuni_io_slider_pressed(const uint8_t *pressure)
+{
+    uint64_t pressed = 0;
+    int i;
+
+    for (i = 0; i < 32; i++) {
+        if (pressure[i] >= CHUNI_IO_EXT_PRESSED) {
+            pressed |= 1ULL << i;
+        }
+    }
+
+    return pressed;
+}
+
+/* A key delivered pressed gets the highest pressure it had since the last
+   delivery, a key delivered released its latest pressure if that is below
+   the threshold. */
+
+static int64_t chuni_io_slider_deliver_held(uint64_t out, const uint8_t *pressure)
+{
+    uint8_t held[32];
+    int i;
+
+    for (i = 0; i < 32; i++) {
+        if (out & (1ULL << i)) {
+            held[i] = chuni_io_slider_max[i] >= CHUNI_IO_EXT_PRESSED ? chuni_io_slider_max[i] : CHUNI_IO_EXT_PRESSED;
+        } else {
+            held[i] = pressure[i] < CHUNI_IO_EXT_PRESSED ? pressure[i] : 0;
+        }
+    }
+
+    memset(chuni_io_slider_max, 0, sizeof(chuni_io_slider_max));
+
+    return chuni_io_slider_deliver(held);
+}
+
+/* Deliver a frame subject to [slider] maxRate. Returns the time the game
+   got the frame, 0 if it was folded. */
+
+static int64_t chuni_io_slider_frame(const uint8_t *pressure, int64_t decoded)
+{
+    uint64_t frame;
+    uint64_t out;
+    int i;
+
+    frame = chuni_io_slider_pressed(pressure);
+
+    for (i = 0; i < 32; i++) {
+        if (pressure[i] > chuni_io_slider_max[i]) {
+            chuni_io_slider_max[i] = pressure[i];
+        }
+    }
+
+    if (!hold_add(&chuni_io_slider_hold, &frame, 1, decoded, &out)) {
+        return 0;
+    }
+
+    return chuni_io_slider_deliver_held(out, pressure);
+}
+
+/* Read timeouts: deliver what was folded once the interval has passed.
+   Without maxRate the latest frame is repeated as before. */
+
+static void chuni_io_slider_flush(const uint8_t *pressure)
+{
+    uint64_t out;
+
+    if (chuni_io_slider_hold.interval == 0) {
+        chuni_io_slider_deliver(pressure);
+    } else if (hold_flush(&chuni_io_slider_hold, 1, chuni_io_qpc(), &out)) {
+        chuni_io_slider_deliver_held(out, pressure);
+    }
+}
+
+/* Deliver outside the rate limit, for disconnects */
+
+static int64_t chuni_io_slider_deliver_now(const uint8_t *pressure)
+{
+    uint64_t frame = chuni_io_slider_pressed(pressure);
+
+    hold_force(&chuni_io_slider_hold, &frame, 1, chuni_io_qpc());
+    memset(chuni_io_slider_max, 0, sizeof(chuni_io_slider_max));
+
+    return chuni_io_slider_deliver(pressure);
+}
+
+static void chuni_io_ext_publish(const uint8_t *pressure, int64_t device_qpc, int64_t host_qpc)
+{
+    uint32_t pressed = 0;
+    int i;
+
+    for (i = 0; i < 32; i++) {
+        if (pressure[i] >= CHUNI_IO_EXT_PRESSED) {
+            pressed |= 1u << i;
+        }
+    }
+
+    InterlockedIncrement(&chuni_io_ext_lock);
+    chuni_io_ext.seq++;
+    memcpy(chuni_io_ext.pressure, pressure, 32);
+    chuni_io_ext.pressed = pressed;
+    chuni_io_ext.beams = Air_key_Status;
+    chuni_io_ext.device_qpc = device_qpc;
+    chuni_io_ext.host_qpc = host_qpc;
+    InterlockedIncrement(&chuni_io_ext_lock);
+}
+
+/* Air-only frame: the slider state and its stamps stay as they were */
+
+static void chuni_io_ext_publish_air(int64_t device_qpc)
+{
+    InterlockedIncrement(&chuni_io_ext_lock);
+    chuni_io_ext.air_seq++;
+    chuni_io_ext.beams = Air_key_Status;
+    chuni_io_ext.air_qpc = device_qpc;
+    InterlockedIncrement(&chuni_io_ext_lock);
+}
+
+bool chuni_io_ext_get_slider(struct chuni_io_ext_slider *out)
+{
+    LONG lock;
+
+    if (out == NULL) {
+        return false;
+    }
+
+    do {
+        lock = chuni_io_ext_lock;
+        MemoryBarrier();
+        *out = chuni_io_ext;
+        MemoryBarrier();
+    } while ((lock & 1) || lock != chuni_io_ext_lock);
+
+    return out->seq != 0;
+}
+
+bool chuni_io_ext_get_cadence(uint8_t api, struct cadence_stats *out)
+{
+    if (out == NULL || api >= CHUNI_IO_API_COUNT) {
+        return false;
+    }
+
+    *out = chuni_io_cadence[api];
+    return true;
+}
+
 static unsigned int __stdcall chuni_io_slider_thread_proc(void* param)
 {
-    callback_context* ctx = (callback_context*)param;
-    chuni_io_slider_callback_t callback = ctx->callback;
-    //Queue* queue = ctx->queue;
     slider_packet_t reponse;
-    uint8_t pressure[32];
+    uint8_t pressure[32] = {0};
+    int64_t decoded;
 	BOOL ESC = FALSE;
 	// uint8_t result = read_serial_port(buffer, recv_len) ;
 	// while(result == 0 && result == 2){
 	// 	result = read_serial_port(buffer, recv_len);
 	// }
     package_init(&reponse);	
-    while (!chuni_io_slider_stop_flag) {
+    for (;;) {
+        if (chuni_io_slider_stop_flag) {
+            SetEvent(chuni_io_slider_parked);
+            WaitForSingleObject(chuni_io_slider_run, INFINITE);
+            continue;
+        }
+
         SetThreadExecutionState(1);
         switch (serial_read_cmd(&reponse)) {
 		    case SLIDER_CMD_AUTO_SCAN:
+                decoded = chuni_io_qpc();
 			    memcpy(pressure, reponse.pressure, 32);
-                if(reponse.size == 33){
+                if(reponse.size >= 33){
                     //32个触摸按键后跟随一位天键
                     Air_key_Status = reponse.air_status;
                 }
+                if(reponse.size >= 34){
+                    //新固件在天键后跟随一位测试/服务/投币键
+                    chuni_io_board_status(reponse.io_status);
+                }
                 if(!LED_status){
                     Air_key_Status = 0;
                     //memset(pressure,0,32);
                 }
                 package_init(&reponse);
-                callback(pressure);
+                chuni_io_ext_publish(pressure, decoded, chuni_io_slider_frame(pressure, decoded));
 			    break;
             case SLIDER_CMD_AUTO_AIR:
                 Air_key_Status = reponse._air_status;
@@ -196,13 +490,21 @@ static unsigned int __stdcall chuni_io_slider_thread_proc(void* param)
                     Air_key_Status = 0;
                 }
                 package_init(&reponse);
+                chuni_io_ext_publish_air(chuni_io_qpc());
                 break;
             case 0xff:
+                Air_key_Status = 0;
+                chuni_io_board_status(0);
                 memset(pressure,0, 32);
-                callback(pressure);
+                decoded = chuni_io_qpc();
+                chuni_io_ext_publish(pressure, decoded, chuni_io_slider_deliver_now(pressure));
                 close_port();
                 while(!open_port()){
                     close_port();
+                    if(chuni_io_slider_stop_flag){
+                        // 停止时不再等待重连，下次开始时重新检测断线
+                        break;
+                    }
                     memcpy(comPort,GetSerialPortByVidPid(vid,pid),6);
                     if(comPort[0] == 0){
                         int port_num = 1;
@@ -217,16 +519,15 @@ static unsigned int __stdcall chuni_io_slider_thread_proc(void* param)
                         
                     }
                     memset(pressure,0, 32);
-                    callback(pressure);
+                    chuni_io_slider_deliver_now(pressure);
                     Sleep(1);
                 }
-                Sleep(1);
                 slider_start_air_scan();
                 slider_start_scan();
-                callback(pressure);
+                chuni_io_slider_deliver_now(pressure);
                 break;
             default:
-                callback(pressure);
+                chuni_io_slider_flush(pressure);
                 break;
         }
         // if (!IsSerialPortOpen()) {
@@ -234,7 +535,7 @@ static unsigned int __stdcall chuni_io_slider_thread_proc(void* param)
         //     while(!open_port()){
         //         close_port();
         //         memset(pressure,0, 32);
-        //         callback(pressure);
+        //         chuni_io_slider_deliver(pressure);
         //         Sleep(1);
         //     }
         //     slider_start_air_scan();
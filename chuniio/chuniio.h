@@ -15,6 +15,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "cadence.h"
+
 /* Get the version of the Chunithm IO API that this DLL supports. This
    function should return a positive 16-bit integer, where the high byte is
    the major version and the low byte is the minor version (as defined by the
@@ -141,3 +143,46 @@ void chuni_io_slider_stop(void);
 void chuni_io_slider_set_leds(const uint8_t *rgb);
 void chuni_io_led_set_colors(uint8_t board,uint8_t *rgb);
 HRESULT chuni_io_led_init(void);
+
+/* Extended exports. These are not part of the segatools API and are never
+   called by the game; hooks and tools can find them with GetProcAddress.
+
+   The board does not timestamp its frames, so device_qpc is the
+   QueryPerformanceCounter value taken as soon as the frame was decoded, and
+   host_qpc the value when the frame was handed to the game callback (0 if
+   the slider was stopped at the time). Air-only frames don't count as
+   slider frames: they update beams, air_seq and air_qpc only. */
+
+#define CHUNI_IO_EXT_PRESSED 20 /* Factory default pressure threshold */
+
+struct chuni_io_ext_slider {
+    uint32_t seq;          /* Frames so far, 0 before the first one */
+    uint8_t pressure[32];  /* Same layout as the callback state */
+    uint32_t pressed;      /* Bit n set if pressure[n] >= CHUNI_IO_EXT_PRESSED */
+    uint8_t beams;         /* As reported by the board */
+    int64_t device_qpc;
+    int64_t host_qpc;
+    uint32_t air_seq;      /* Air frames so far */
+    int64_t air_qpc;       /* When the latest air frame was decoded */
+};
+
+/* Copy the latest slider frame. Returns false if none has arrived yet. */
+
+bool chuni_io_ext_get_slider(struct chuni_io_ext_slider *out);
+
+/* Call cadence of the game-facing entry points (see cadence.h). The slider
+   callback is timed around the call into the game. Gaps longer than
+   [cadence] gapThreshold ms are counted in gaps. */
+
+enum {
+    CHUNI_IO_API_JVS_POLL = 0,
+    CHUNI_IO_API_JVS_READ_COIN_COUNTER = 1,
+    CHUNI_IO_API_SLIDER_SET_LEDS = 2,
+    CHUNI_IO_API_LED_SET_COLORS = 3,
+    CHUNI_IO_API_SLIDER_CALLBACK = 4,
+    CHUNI_IO_API_COUNT = 5,
+};
+
+/* Copy the stats of one API. Returns false if api is out of range. */
+
+bool chuni_io_ext_get_cadence(uint8_t api, struct cadence_stats *out);
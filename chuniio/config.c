@@ -32,6 +32,26 @@ void chuni_io_config_load(
     cfg->vk_coin = GetPrivateProfileIntW(L"io3", L"coin", '3', filename);
     //cfg->vk_ir = GetPrivateProfileIntW(L"io3", L"ir", VK_SPACE, filename);
 
+    /* Turn off when the board reports the operator buttons itself */
+    cfg->keyboard = GetPrivateProfileIntW(L"io3", L"keyboard", 1, filename);
+
+    /* Keep the board streaming across slider stop/start, only gating callbacks */
+    cfg->keep_warm = GetPrivateProfileIntW(L"slider", L"keepWarm", 0, filename);
+
+    /* Treat the board as disconnected after this many ms without a frame, 0 disables */
+    cfg->liveness_timeout = GetPrivateProfileIntW(L"slider", L"livenessTimeout", 100, filename);
+
+    /* Call the game at most this many times a second, folding the frames in between (holddec.h). 0 disables */
+    cfg->max_rate = GetPrivateProfileIntW(L"slider", L"maxRate", 0, filename);
+
+    /* Raise and lower the hand over several polls instead of passing the
+       board's beams straight through */
+    cfg->air_synth = GetPrivateProfileIntW(L"ir", L"synth", 0, filename);
+    cfg->air_synth_step = GetPrivateProfileIntW(L"ir", L"synthStep", 1, filename);
+
+    /* Gaps between game calls longer than this many ms are counted, 0 disables */
+    cfg->cadence_gap = GetPrivateProfileIntW(L"cadence", L"gapThreshold", 50, filename);
+
     //for (i = 0 ; i < 32 ; i++) {
     //    swprintf_s(key, _countof(key), L"cell%i", i + 1);
     //    cfg->vk_cell[i] = GetPrivateProfileIntW(
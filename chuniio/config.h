@@ -3,12 +3,21 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <stdbool.h>
+
 struct chuni_io_config {
     uint8_t vk_test;
     uint8_t vk_service;
     uint8_t vk_coin;
+    bool keyboard;
+    uint32_t max_rate;
     uint8_t vk_ir;
     uint8_t vk_cell[32];
+    bool keep_warm;
+    uint32_t liveness_timeout;
+    uint32_t cadence_gap;
+    bool air_synth;
+    uint8_t air_synth_step;
 };
 
 void chuni_io_config_load(
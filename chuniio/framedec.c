@@ -0,0 +1,158 @@
+#include "framedec.h"
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+enum {
+	FRAME_WAIT_SYN = 0,
+	FRAME_CMD,
+	FRAME_SIZE,
+	FRAME_BODY
+};
+
+void frame_decoder_reset(frame_decoder_t *d){
+	d->state = FRAME_WAIT_SYN;
+	d->esc = 0;
+	d->sum = 0;
+	d->pos = 0;
+	d->end = 0;
+}
+
+bool frame_checksum_ok(const frame_decoder_t *d){
+	return d->end != 0 && d->data[d->end - 1] == d->sum;
+}
+
+// 逐字节解析，返回真表示一帧结束
+static bool frame_step(frame_decoder_t *d, uint8_t c){
+	if(c == 0xff){
+		d->data[0] = c;
+		d->state = FRAME_CMD;
+		d->esc = 0;
+		d->sum = c;
+		return false;
+	}
+	if(d->state == FRAME_WAIT_SYN){
+		return false;
+	}
+	if(c == 0xfd){
+		d->esc = 1;
+		return false;
+	}
+	if(d->esc){
+		c++;
+		d->esc = 0;
+	}
+	switch(d->state){
+	case FRAME_CMD:
+		d->data[1] = c;
+		d->sum += c;
+		d->state = FRAME_SIZE;
+		return false;
+	case FRAME_SIZE:
+		if(c + 4 > FRAME_DECODER_SIZE){
+			d->state = FRAME_WAIT_SYN;
+			return false;
+		}
+		d->data[2] = c;
+		d->sum += c;
+		d->pos = 3;
+		d->end = c + 4;
+		d->state = FRAME_BODY;
+		return false;
+	default:
+		d->data[d->pos++] = c;
+		if(d->pos == d->end){
+			d->state = FRAME_WAIT_SYN;
+			return true;
+		}
+		d->sum += c;
+		return false;
+	}
+}
+
+size_t frame_decode_scalar(frame_decoder_t *d, const uint8_t *buf, size_t len, bool *done){
+	size_t i = 0;
+	*done = false;
+	while(i < len){
+		if(frame_step(d, buf[i++])){
+			*done = true;
+			break;
+		}
+	}
+	return i;
+}
+
+#ifdef __SSE2__
+// 跳过帧头之前的数据，返回第一个0xFF之前的字节数
+static size_t frame_skip_to_syn(const uint8_t *buf, size_t len){
+	const __m128i ff = _mm_set1_epi8((char)0xff);
+	size_t n = 0;
+	while(len - n >= 16){
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + n)), ff));
+		if(mask){
+			return n + __builtin_ctz(mask);
+		}
+		n += 16;
+	}
+	return n;
+}
+
+// 复制payload中不含0xFF/0xFD的一段，校验字节不在此处理。返回复制的字节数
+static size_t frame_copy_run(frame_decoder_t *d, const uint8_t *buf, size_t len){
+	const __m128i ff = _mm_set1_epi8((char)0xff);
+	const __m128i fd = _mm_set1_epi8((char)0xfd);
+	const __m128i index = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m128i sums = _mm_setzero_si128();
+	size_t want = d->end - 1 - d->pos;
+	size_t n = 0;
+	while(len - n >= 16 && n < want){
+		__m128i v = _mm_loadu_si128((const __m128i *)(buf + n));
+		unsigned special = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, ff), _mm_cmpeq_epi8(v, fd)));
+		size_t run = special ? (size_t)__builtin_ctz(special) : 16;
+		if(run > want - n){
+			run = want - n;
+		}
+		if(run == 0){
+			break;
+		}
+		// 只累加前run个字节
+		__m128i keep = _mm_cmplt_epi8(index, _mm_set1_epi8((char)run));
+		sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_and_si128(v, keep), _mm_setzero_si128()));
+		memcpy(&d->data[d->pos], buf + n, run);
+		d->pos += run;
+		n += run;
+		if(run < 16){
+			break;
+		}
+	}
+	sums = _mm_add_epi64(sums, _mm_srli_si128(sums, 8));
+	d->sum += (uint8_t)_mm_cvtsi128_si32(sums);
+	return n;
+}
+#endif
+
+size_t frame_decode(frame_decoder_t *d, const uint8_t *buf, size_t len, bool *done){
+#ifdef __SSE2__
+	size_t i = 0;
+	*done = false;
+	while(i < len){
+		if(d->state == FRAME_WAIT_SYN){
+			i += frame_skip_to_syn(buf + i, len - i);
+		}else if(d->state == FRAME_BODY && !d->esc && d->pos + 1 < d->end){
+			i += frame_copy_run(d, buf + i, len - i);
+		}
+		if(i == len){
+			break;
+		}
+		if(frame_step(d, buf[i++])){
+			*done = true;
+			break;
+		}
+	}
+	return i;
+#else
+	return frame_decode_scalar(d, buf, len, done);
+#endif
+}
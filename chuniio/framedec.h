@@ -0,0 +1,33 @@
+#ifndef FRAMEDEC_H
+#define FRAMEDEC_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// 串口帧解析：0xFF为帧头，0xFD为转义（下一字节加1），之后是cmd、size、payload和校验和。
+// 解析状态保存在frame_decoder_t中，一帧可以分散在多次读取的数据里。
+//
+// frame_decode一次处理一段缓冲区：等待帧头时按16字节查找0xFF，
+// 接收payload时按16字节查找0xFF/0xFD，之前的普通字节整段memcpy并用SAD指令累加校验和，
+// 只有帧头、转义和校验字节逐字节处理。没有SSE2时退回逐字节解析，结果与frame_decode_scalar一致。
+
+#define FRAME_DECODER_SIZE 128 // 与slider_packet_t.data相同
+
+typedef struct frame_decoder {
+	uint8_t data[FRAME_DECODER_SIZE]; // syn cmd size payload... checksum，与slider_packet_t.data布局相同
+	uint8_t state;
+	uint8_t esc;
+	uint8_t sum;  // syn到payload末尾所有字节之和
+	uint16_t pos; // data中下一个写入位置
+	uint16_t end; // size + 4
+} frame_decoder_t;
+
+void frame_decoder_reset(frame_decoder_t *d);
+
+// 返回消耗的字节数。*done为真时data中是一帧完整数据，剩余字节留到下次调用
+size_t frame_decode(frame_decoder_t *d, const uint8_t *buf, size_t len, bool *done);
+size_t frame_decode_scalar(frame_decoder_t *d, const uint8_t *buf, size_t len, bool *done);
+
+bool frame_checksum_ok(const frame_decoder_t *d);
+
+#endif
@@ -1,4 +1,6 @@
 #include "serialslider.h"
+#include "framedec.h"
+#include "serialtune.h"
 #include <windows.h>
 //#include <setupapi.h>
 #include <stdio.h>
@@ -59,75 +61,113 @@ DCB dcb; // 串口参数结构体
 COMMTIMEOUTS timeouts; // 串口超时结构体
 OVERLAPPED ovWrite;
 BOOL fWaitingOnRead = FALSE, fWaitingOnWrite = FALSE;
-slider_packet_t request;
 BOOL Serial_Status;//串口状态（是否成功打开）
 
-// 临界区用于保护队列
-CRITICAL_SECTION cs;
-
-Queue* createQueue(int capacity) {
-    Queue* queue = (Queue*)malloc(sizeof(Queue));
-    queue->capacity = capacity;
-    queue->front = queue->size = 0;
-    queue->rear = capacity - 1;
-    queue->items = (char*)malloc(queue->capacity * sizeof(char));
-    return queue;
-}
-
-void enqueue(Queue* queue, char item) {
-    if (queue->size == queue->capacity) return;
-    queue->rear = (queue->rear + 1) % queue->capacity;
-    queue->items[queue->rear] = item;
-    queue->size = queue->size + 1;
-}
-
-char dequeue(Queue* queue) {
-    if (queue->size == 0) return '\0';
-    char item = queue->items[queue->front];
-    queue->front = (queue->front + 1) % queue->capacity;
-    queue->size = queue->size - 1;
-    return item;
-}
+// 串口以重叠I/O方式打开，读和写各自独立进行：
+// 游戏线程发送灯光数据时不再需要等待读取线程正在进行的ReadFile返回
+static OVERLAPPED ovRead;
+static uint8_t read_buf[READ_BUF_SIZE];
+static DWORD read_pos = 0;
+static DWORD read_len = 0;
+static frame_decoder_t rx_frame;
+
+// 发送命令队列（多生产者单消费者，无锁）
+// 灯光线程、JVS线程和重连流程各自把完整的帧编码进自己占用的槽位，
+// 由唯一的写线程按顺序取出并合并发送，帧之间不会互相穿插。
+// 每个槽位的seq表示状态：seq == pos 空闲可写，seq == pos + 1 已写好可读
+#define CMD_QUEUE_SLOTS 32 // 必须是2的幂
+
+typedef struct cmd_slot {
+	volatile LONG seq;
+	uint8_t length;
+	uint8_t data[BUFSIZE];
+} cmd_slot_t;
+
+static cmd_slot_t cmd_queue[CMD_QUEUE_SLOTS];
+static volatile LONG cmd_head = 0;
+static LONG cmd_tail = 0; // 只有写线程访问
+static volatile LONG cmd_queue_ready = 0; // slider_queue_init成功后为1，之前入队的帧直接丢弃
+static HANDLE cmd_event;
+
+// 写线程使用hPort期间（共享）与读取线程关闭/重新打开串口（独占）互斥，
+// 避免写线程在已关闭的句柄或被系统复用的句柄值上写入
+static SRWLOCK port_lock = SRWLOCK_INIT;
+static slider_queue_stats_t cmd_stats;
+
+// 开始扫描命令的确认：板子没有单独的应答，收到第一帧扫描数据即视为确认，
+// 超时未确认则重发。重发检查在serial_read_cmd中进行，读取线程每5毫秒内至少调用一次
+#define SCAN_ACK_TIMEOUT 20 // 毫秒
+#define SCAN_ACK_RETRIES 5
+#define SCAN_PENDING_GROUND 0x01
+#define SCAN_PENDING_AIR 0x02
+
+static volatile LONG scan_pending = 0;
+static volatile DWORD scan_sent_at;
+static volatile LONG scan_retries;
+static LARGE_INTEGER scan_request_time;
+static volatile LONG scan_confirm_us = -1;
+static volatile LONG scan_confirm_retries;
+
+// 连接存活检测：超过liveness_timeout毫秒没有收到任何完整的帧，就当作断开处理。
+// 有些USB Hub上板子卡死后句柄仍然有效，GetCommState不会失败，游戏会一直收到最后一帧
+static DWORD liveness_timeout = 0; // 0 不检测
+static volatile DWORD last_frame_tick;
+static volatile LONG liveness_timeouts;
+static volatile LONG liveness_detect_ms;
+
+// 串口驱动参数，默认值对应Affine的CDC板子：
+// 有数据立即返回、没有数据最多等待5毫秒，打开DTR，其余线路保持驱动默认
+static struct serial_tune slider_tune = {
+	.in_queue = 4096,
+	.out_queue = 4096,
+	.read_interval = MAXDWORD,
+	.read_constant = 5,
+	.read_multiplier = MAXDWORD,
+	.write_constant = 100,
+	.write_multiplier = 10,
+	.dtr = DTR_CONTROL_ENABLE,
+	.rts = SERIAL_TUNE_KEEP,
+	.cts_flow = SERIAL_TUNE_KEEP,
+	.dsr_flow = SERIAL_TUNE_KEEP,
+	.latency_timer = 0,
+};
 
 // Windows Serial helpers
 BOOL open_port()
 {
     // 打开串口
-    hPort = CreateFile(comPort, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    AcquireSRWLockExclusive(&port_lock);
+    hPort = CreateFile(comPort, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
     if (hPort == INVALID_HANDLE_VALUE)
     {
+        ReleaseSRWLockExclusive(&port_lock);
         //printf("can't open %s!\n", comPort);
         return FALSE;
     }
 
-    // 获取串口参数
-    GetCommState(hPort, &dcb);
-    // 设置串口参数
-    dcb.BaudRate = 115200; // 设置波特率
-    dcb.ByteSize = 8; // 设置数据位为8
-    dcb.Parity = NOPARITY; // 设置无奇偶校验
-    dcb.StopBits = ONESTOPBIT; // 设置停止位为1
-    SetCommState(hPort, &dcb);
-
-    // 获取串口超时
-    GetCommTimeouts(hPort, &timeouts);
-
-    // 设置串口超时
-    timeouts.ReadIntervalTimeout = 1; // 设置读取间隔超时为1毫秒
-    timeouts.ReadTotalTimeoutConstant = 5; // 设置读取总超时常量为5毫秒
-    timeouts.ReadTotalTimeoutMultiplier = 1; // 设置读取总超时乘数为1毫秒
-    timeouts.WriteTotalTimeoutConstant = 100; // 设置写入总超时常量为100毫秒
-    timeouts.WriteTotalTimeoutMultiplier = 10; // 设置写入总超时乘数为10毫秒
-    SetCommTimeouts(hPort, &timeouts);
-	EscapeCommFunction(hPort,SETDTR); //发送DTR信号
-	//EscapeCommFunction(hPort,3); //发送RTS信号
+    // 队列大小、DTR/RTS、流控和超时按设备配置设置（见serialtune.h）
+    serial_tune_apply(hPort, &slider_tune);
+    ReleaseSRWLockExclusive(&port_lock);
+
+    if (ovRead.hEvent == NULL) {
+        ovRead.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    }
+    if (ovWrite.hEvent == NULL) {
+        ovWrite.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    }
+    read_pos = read_len = 0;
+    frame_decoder_reset(&rx_frame);
+    last_frame_tick = GetTickCount();
     // 返回成功
     return TRUE;
 }
 
 void close_port(){
+	AcquireSRWLockExclusive(&port_lock);
 	CloseHandle(hPort);
 	hPort = INVALID_HANDLE_VALUE;
+	ReleaseSRWLockExclusive(&port_lock);
+	read_pos = read_len = 0;
 }
 
 // 检查串口是否打开
@@ -149,25 +189,123 @@ void package_init(slider_packet_t *request){
 	}
 }
 
+// 只由写线程调用
 BOOL send_data(int length,uint8_t *send_buffer)
 {
     DWORD bytes_written; // 写入的字节数
-	// while (fWaitingOnWrite) {
-    //     // Already waiting for a write to complete.
-    // }
-    // // Write data to the port asynchronously.
-    // fWaitingOnWrite = TRUE;
-    // 写入数据
-    if (!WriteFile(hPort, send_buffer, length, &bytes_written, NULL))
-    {
-        // printf("can't write data to");
-		// printf(comPort);
-		// printf("/n");
-        return FALSE;
-    }
-    // 返回成功
-	//WriteFile(hPort, send_buffer, length, &bytes_written, &ovWrite);
-    return TRUE;
+    BOOL result;
+
+    // 重叠写入，与读取线程的ReadFile互不阻塞；这里等待写入完成后再返回。
+    // 写入有超时（见serialtune.h），重连最多等待一次写入结束
+    AcquireSRWLockShared(&port_lock);
+    result = WriteFile(hPort, send_buffer, length, NULL, &ovWrite) || GetLastError() == ERROR_IO_PENDING;
+    result = result && GetOverlappedResult(hPort, &ovWrite, &bytes_written, TRUE);
+    ReleaseSRWLockShared(&port_lock);
+
+    return result;
+}
+
+// 取出队列中所有已写好的帧，拼接到buffer中，返回总长度
+static int cmd_queue_drain(uint8_t *buffer, int capacity){
+	cmd_slot_t *slot;
+	int length = 0;
+	while(length + BUFSIZE <= capacity){
+		slot = &cmd_queue[cmd_tail & (CMD_QUEUE_SLOTS - 1)];
+		// 队列为空，或者生产者还没写完这个槽位（写完后会再次唤醒写线程）
+		if(slot->seq != cmd_tail + 1){
+			break;
+		}
+		memcpy(buffer + length, slot->data, slot->length);
+		length += slot->length;
+		InterlockedExchange(&slot->seq, cmd_tail + CMD_QUEUE_SLOTS);
+		cmd_tail++;
+	}
+	return length;
+}
+
+static DWORD WINAPI slider_writer_thread(LPVOID param){
+	uint8_t batch[CMD_QUEUE_SLOTS * BUFSIZE];
+	int length;
+	while(1){
+		WaitForSingleObject(cmd_event, INFINITE);
+		while((length = cmd_queue_drain(batch, sizeof(batch))) > 0){
+			// 端口断开时发送失败，帧直接丢弃，重连后会重新发送开始扫描命令
+			send_data(length, batch);
+			InterlockedIncrement(&cmd_stats.batches);
+		}
+	}
+	return 0;
+}
+
+// 创建写线程和它等待的事件，只在滑条初始化时调用一次
+BOOL slider_queue_init(){
+	HANDLE thread;
+	if(cmd_queue_ready){
+		return TRUE;
+	}
+	for(LONG i = 0;i < CMD_QUEUE_SLOTS;i++){
+		cmd_queue[i].seq = i;
+	}
+	cmd_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if(cmd_event == NULL){
+		return FALSE;
+	}
+	thread = CreateThread(NULL, 0, slider_writer_thread, NULL, 0, NULL);
+	if(thread == NULL){
+		CloseHandle(cmd_event);
+		cmd_event = NULL;
+		return FALSE;
+	}
+	CloseHandle(thread);
+	InterlockedExchange(&cmd_queue_ready, 1);
+	return TRUE;
+}
+
+static void cmd_queue_push(const uint8_t *frame, uint8_t length){
+	cmd_slot_t *slot;
+	LONG pos;
+	LONG prev;
+	LONG diff;
+
+	if(!cmd_queue_ready){
+		return;
+	}
+
+	pos = cmd_head;
+	while(1){
+		slot = &cmd_queue[pos & (CMD_QUEUE_SLOTS - 1)];
+		diff = (LONG)((ULONG)slot->seq - (ULONG)pos);
+		if(diff == 0){
+			prev = InterlockedCompareExchange(&cmd_head, pos + 1, pos);
+			if(prev == pos){
+				break;
+			}
+			// 其他线程抢先占用了这个槽位
+			InterlockedIncrement(&cmd_stats.cas_retries);
+			pos = prev;
+		}else if(diff < 0){
+			// 队列已满，等待写线程取走
+			InterlockedIncrement(&cmd_stats.full_waits);
+			SetEvent(cmd_event);
+			Sleep(1);
+			pos = cmd_head;
+		}else{
+			pos = cmd_head;
+		}
+	}
+
+	memcpy(slot->data, frame, length);
+	slot->length = length;
+	InterlockedExchange(&slot->seq, pos + 1);
+	InterlockedIncrement(&cmd_stats.enqueued);
+	SetEvent(cmd_event);
+}
+
+void slider_queue_get_stats(slider_queue_stats_t *stats){
+	stats->enqueued = cmd_stats.enqueued;
+	stats->cas_retries = cmd_stats.cas_retries;
+	stats->full_waits = cmd_stats.full_waits;
+	stats->batches = cmd_stats.batches;
 }
 
 static uint32_t millis() {
@@ -189,7 +327,7 @@ void sliderserial_writeresp(slider_packet_t *request) {
 	// 	request.checksum[1] = 0xfe;
 	// 	uint8_t length = request.size + 4;
 	// }
-	send_data(length,request->data);
+	cmd_queue_push(request->data, length);
 }
 
 // int read_serial_port(LPVOID lpBuf, DWORD dwRead) {
@@ -259,70 +397,140 @@ void sliderserial_writeresp(slider_packet_t *request) {
 //         }
 //     }
 // }
-BOOL serial_read1(uint8_t *result){
-	long unsigned int recv_len;
-	if (ReadFile(hPort,  result, 1, &recv_len, NULL) && (recv_len != 0)){
-		return TRUE;
+static void slider_scan_send(LONG pending){
+	slider_packet_t request;
+	package_init(&request);
+	request.syn = 0xff;
+	request.size = 0;
+	if(pending & SCAN_PENDING_AIR){
+		request.cmd = SLIDER_CMD_AUTO_AIR_START;
+		sliderserial_writeresp(&request);
 	}
-	else{
-		return false;
+	if(pending & SCAN_PENDING_GROUND){
+		request.cmd = SLIDER_CMD_AUTO_SCAN_START;
+		sliderserial_writeresp(&request);
 	}
-	
 }
 
+static void slider_scan_request(LONG bit){
+	// 重新开始扫描前没有数据是正常的
+	last_frame_tick = GetTickCount();
+	if(InterlockedOr(&scan_pending, bit) == 0){
+		QueryPerformanceCounter(&scan_request_time);
+		scan_retries = 0;
+	}
+	scan_sent_at = GetTickCount();
+	slider_scan_send(bit);
+}
+
+// 只确认收到的那一种扫描，最后一种也确认后记录确认时间
+static void slider_scan_confirm(LONG bit){
+	LARGE_INTEGER now, freq;
+	LONG before = InterlockedAnd(&scan_pending, ~bit);
+	if((before & bit) == 0 || (before & ~bit) != 0){
+		return;
+	}
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	scan_confirm_us = (LONG)((now.QuadPart - scan_request_time.QuadPart) * 1000000 / freq.QuadPart);
+	scan_confirm_retries = scan_retries;
+}
+
+static void slider_scan_check(){
+	LONG pending = scan_pending;
+	if(pending == 0 || GetTickCount() - scan_sent_at < SCAN_ACK_TIMEOUT){
+		return;
+	}
+	if(scan_retries >= SCAN_ACK_RETRIES){
+		// 放弃重发，等待断线重连流程重新开始
+		InterlockedExchange(&scan_pending, 0);
+		return;
+	}
+	scan_retries++;
+	scan_sent_at = GetTickCount();
+	slider_scan_send(pending);
+}
+
+// 只在串口关闭时调用，下次open_port生效
+void slider_set_tune(const struct serial_tune *tune){
+	slider_tune = *tune;
+}
+
+void slider_get_tune(struct serial_tune *tune){
+	*tune = slider_tune;
+}
+
+void slider_set_liveness_timeout(DWORD timeout){
+	liveness_timeout = timeout;
+}
+
+void slider_get_liveness_stats(LONG *timeouts, LONG *detect_ms){
+	*timeouts = liveness_timeouts;
+	*detect_ms = liveness_detect_ms;
+}
+
+void slider_get_scan_timing(LONG *confirm_us, LONG *retries){
+	*confirm_us = scan_confirm_us;
+	*retries = scan_confirm_retries;
+}
+
+// 一次读取缓冲区中所有可用数据
+static BOOL serial_fill(){
+	DWORD recv_len;
+	if (!ReadFile(hPort, read_buf, READ_BUF_SIZE, NULL, &ovRead) && GetLastError() != ERROR_IO_PENDING){
+		return FALSE;
+	}
+	if (!GetOverlappedResult(hPort, &ovRead, &recv_len, TRUE) || (recv_len == 0)){
+		return FALSE;
+	}
+	read_pos = 0;
+	read_len = recv_len;
+	return TRUE;
+}
+
+BOOL serial_read1(uint8_t *result){
+	if (read_pos >= read_len && !serial_fill()){
+		return FALSE;
+	}
+	*result = read_buf[read_pos++];
+	return TRUE;
+}
+
+// 整段缓冲区交给frame_decode解析，解析状态跨多次读取保留
 uint8_t serial_read_cmd(slider_packet_t *reponse){
-	uint8_t checksum = 0;
-	uint8_t rep_size = 0;
-	BOOL ESC = FALSE;
-	uint8_t c;
-	COMSTAT comStat;
-	DWORD   dwErrors = 0;
-	while(serial_read1(&c)){
-		if(c == 0xff){
-			package_init(reponse);
-			rep_size = 0;
-			reponse->syn = c;
-			ESC = FALSE;
-			checksum += 0xff;
-			continue;
-			}
-		if(reponse->syn != 0xff){
-			continue;
-		}
-		if(c == 0xfd){
-			ESC = TRUE;
+	bool done;
+	slider_scan_check();
+	while(read_pos < read_len || serial_fill()){
+		read_pos += frame_decode(&rx_frame, &read_buf[read_pos], read_len - read_pos, &done);
+		if(!done){
 			continue;
 		}
-		if(ESC){
-			c ++;
-			ESC = FALSE;
+		package_init(reponse);
+		memcpy(reponse->data, rx_frame.data, rx_frame.end);
+		last_frame_tick = GetTickCount();
+		if(scan_pending && reponse->cmd == SLIDER_CMD_AUTO_SCAN){
+			// 33字节以上的地键帧同时带有天键状态
+			slider_scan_confirm(reponse->size >= 33 ? SCAN_PENDING_GROUND | SCAN_PENDING_AIR : SCAN_PENDING_GROUND);
+		}else if(scan_pending && reponse->cmd == SLIDER_CMD_AUTO_AIR){
+			slider_scan_confirm(SCAN_PENDING_AIR);
 		}
-		if(reponse->cmd == 0){
-			reponse->cmd = c;
-			checksum += reponse->cmd;
-			continue;
-		}
-		if(rep_size == 0){
-			reponse->size = c;
-			rep_size = 3;
-			checksum += reponse->size;
-			continue;
-		}
-		reponse->data[rep_size] = c;
-		checksum += c;
-		if ((rep_size == reponse->size + 3) || (rep_size >128) ){
-			return reponse->cmd;
-		}
-		rep_size++;
+		return reponse->cmd;
 	}
 	if (!GetCommState(hPort, &dcb)) {
     // 串口已断开
 	return 0xff;
 	}
+	if (liveness_timeout != 0 && GetTickCount() - last_frame_tick > liveness_timeout) {
+		// 句柄仍然有效但板子已经没有响应
+		liveness_detect_ms = GetTickCount() - last_frame_tick;
+		InterlockedIncrement(&liveness_timeouts);
+		return 0xff;
+	}
 	return 0xfe;
 }
 
 void slider_rst(){
+	slider_packet_t request;
 	package_init(&request);
 	request.syn = 0xff;
 	request.cmd = SLIDER_CMD_RESET;
@@ -332,30 +540,21 @@ void slider_rst(){
 }
 
 void slider_start_scan(){
-	package_init(&request);
-	request.syn = 0xff;
-	request.cmd = SLIDER_CMD_AUTO_SCAN_START;
-	request.size = 0;
-	sliderserial_writeresp(&request);
-	Sleep(1);
+	slider_scan_request(SCAN_PENDING_GROUND);
 }
 
 void slider_stop_scan(){
+	slider_packet_t request;
 	package_init(&request);
 	request.syn = 0xff;
 	request.cmd = SLIDER_CMD_AUTO_SCAN_STOP;
 	request.size = 0;
+	InterlockedExchange(&scan_pending, 0);
 	sliderserial_writeresp(&request);
-	Sleep(1);
 }
 
 void slider_start_air_scan(){
-	package_init(&request);
-	request.syn = 0xff;
-	request.cmd = SLIDER_CMD_AUTO_AIR_START;
-	request.size = 0;
-	sliderserial_writeresp(&request);
-	Sleep(1);
+	slider_scan_request(SCAN_PENDING_AIR);
 }
 
 // void slider_stop_air_scan(){
@@ -368,6 +567,7 @@ void slider_start_air_scan(){
 // }
 
 void slider_send_leds(const uint8_t *rgb){
+	slider_packet_t request;
 	package_init(&request);
 	request.syn = 0xff;
 	request.cmd = SLIDER_CMD_SET_LED;
@@ -378,6 +578,7 @@ void slider_send_leds(const uint8_t *rgb){
 }
 
 void slider_send_air_leds(const uint8_t *rgb){
+	slider_packet_t request;
 	package_init(&request);
 	request.syn = 0xff;
 	request.cmd = SLIDER_CMD_SET_AIR_LED;
@@ -9,6 +9,7 @@
 #include <conio.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include "serialtune.h"
 
 #define BUFSIZE 128
 #define CMD_TIMEOUT 3000
@@ -39,6 +40,7 @@ typedef union slider_packet {
 			struct{
 				uint8_t pressure[32];
 				uint8_t air_status;
+				uint8_t io_status; // 新固件：测试/服务/投币键
 			};
 			uint8_t air_leds[3];
 			uint8_t _air_status;
@@ -47,21 +49,15 @@ typedef union slider_packet {
 	uint8_t data[BUFSIZE];
 } slider_packet_t;
 
-typedef struct Queue {
-    char* items;
-    int front;
-    int rear;
-    int size;
-    int capacity;
-} Queue;
-
-extern slider_packet_t request;
-extern CRITICAL_SECTION cs;
+// 发送命令队列统计
+typedef struct slider_queue_stats {
+	LONG enqueued;    // 入队的帧数
+	LONG cas_retries; // 多个线程同时入队产生冲突、需要重试的次数
+	LONG full_waits;  // 队列已满、生产者需要等待的次数
+	LONG batches;     // 写线程调用WriteFile的次数（每次可能合并多帧）
+} slider_queue_stats_t;
 
 const char* GetSerialPortByVidPid(const char* vid, const char* pid);
-Queue* createQueue(int capacity);
-void enqueue(Queue* queue, char item);
-char dequeue(Queue* queue);
 BOOL open_port();
 void close_port();
 BOOL IsSerialPortOpen();
@@ -76,5 +72,12 @@ void slider_stop_scan();
 void slider_send_leds(const uint8_t *rgb);
 void slider_send_air_leds(const uint8_t *rgb);
 void slider_start_air_scan();
+BOOL slider_queue_init();
+void slider_queue_get_stats(slider_queue_stats_t *stats);
+void slider_get_scan_timing(LONG *confirm_us, LONG *retries);
+void slider_set_tune(const struct serial_tune *tune);
+void slider_get_tune(struct serial_tune *tune);
+void slider_set_liveness_timeout(DWORD timeout);
+void slider_get_liveness_stats(LONG *timeouts, LONG *detect_ms);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <windows.h>
+#include <SetupAPI.h>
+
+#include <string.h>
+#include <wchar.h>
+
+/* Per-device serial driver tuning.
+
+   A profile holds the driver queue sizes passed to SetupComm, the
+   COMMTIMEOUTS values, the DTR/RTS lines, CTS/DSR output flow control and
+   the vendor latency timer. Each IO DLL starts from built-in defaults for
+   its Affine board and then reads overrides from a segatools.ini section
+   named after the device's hardware ID, e.g.
+
+       [serial.VID_AFF1&PID_52A4]
+       inQueue=4096
+       outQueue=4096
+       readInterval=-1
+       readConstant=5
+       readMultiplier=-1
+       writeConstant=100
+       writeMultiplier=10
+       dtr=1
+       rts=-1
+       ctsFlow=0
+       dsrFlow=0
+       latencyTimer=0
+
+   A line or flow value of -1 (SERIAL_TUNE_KEEP) leaves whatever the driver
+   reports untouched. The queue sizes are only passed on when both are
+   non-zero. latencyTimer is the LatencyTimer value (ms) that FTDI style
+   drivers read from the device key when the port is opened; the Affine
+   boards are CDC devices with no such knob, so 0 skips it. The same header
+   is used by every IO DLL. */
+
+#define SERIAL_TUNE_KEEP MAXDWORD
+
+struct serial_tune {
+    DWORD in_queue;
+    DWORD out_queue;
+    DWORD read_interval;
+    DWORD read_constant;
+    DWORD read_multiplier;
+    DWORD write_constant;
+    DWORD write_multiplier;
+    DWORD dtr;              /* DTR_CONTROL_* or SERIAL_TUNE_KEEP */
+    DWORD rts;              /* RTS_CONTROL_* or SERIAL_TUNE_KEEP */
+    DWORD cts_flow;
+    DWORD dsr_flow;
+    DWORD latency_timer;
+};
+
+static inline void serial_tune_section(wchar_t *section, size_t count, const char *vid, const char *pid)
+{
+    _snwprintf(section, count, L"serial.%hs&%hs", vid, pid);
+    section[count - 1] = L'\0';
+}
+
+/* Overrides the values in t with whatever the ini section sets */
+
+static inline void serial_tune_load(
+        struct serial_tune *t,
+        const char *vid,
+        const char *pid,
+        const wchar_t *filename)
+{
+    wchar_t section[64];
+
+    serial_tune_section(section, _countof(section), vid, pid);
+
+    t->in_queue = GetPrivateProfileIntW(section, L"inQueue", t->in_queue, filename);
+    t->out_queue = GetPrivateProfileIntW(section, L"outQueue", t->out_queue, filename);
+    t->read_interval = GetPrivateProfileIntW(section, L"readInterval", t->read_interval, filename);
+    t->read_constant = GetPrivateProfileIntW(section, L"readConstant", t->read_constant, filename);
+    t->read_multiplier = GetPrivateProfileIntW(section, L"readMultiplier", t->read_multiplier, filename);
+    t->write_constant = GetPrivateProfileIntW(section, L"writeConstant", t->write_constant, filename);
+    t->write_multiplier = GetPrivateProfileIntW(section, L"writeMultiplier", t->write_multiplier, filename);
+    t->dtr = GetPrivateProfileIntW(section, L"dtr", t->dtr, filename);
+    t->rts = GetPrivateProfileIntW(section, L"rts", t->rts, filename);
+    t->cts_flow = GetPrivateProfileIntW(section, L"ctsFlow", t->cts_flow, filename);
+    t->dsr_flow = GetPrivateProfileIntW(section, L"dsrFlow", t->dsr_flow, filename);
+    t->latency_timer = GetPrivateProfileIntW(section, L"latencyTimer", t->latency_timer, filename);
+}
+
+/* Sets up an open port for 115200 8N1 with the profile's queues, lines and
+   timeouts. Returns FALSE if the driver rejected the state or timeouts. */
+
+static inline BOOL serial_tune_apply(HANDLE h, const struct serial_tune *t)
+{
+    DCB dcb;
+    COMMTIMEOUTS timeouts;
+
+    if (t->in_queue != 0 && t->out_queue != 0) {
+        /* Only a recommendation, drivers may round or ignore it */
+        SetupComm(h, t->in_queue, t->out_queue);
+    }
+
+    memset(&dcb, 0, sizeof(dcb));
+    dcb.DCBlength = sizeof(dcb);
+
+    if (!GetCommState(h, &dcb)) {
+        return FALSE;
+    }
+
+    dcb.BaudRate = 115200;
+    dcb.ByteSize = 8;
+    dcb.Parity = NOPARITY;
+    dcb.StopBits = ONESTOPBIT;
+
+    if (t->dtr != SERIAL_TUNE_KEEP) {
+        dcb.fDtrControl = t->dtr;
+    }
+    if (t->rts != SERIAL_TUNE_KEEP) {
+        dcb.fRtsControl = t->rts;
+    }
+    if (t->cts_flow != SERIAL_TUNE_KEEP) {
+        dcb.fOutxCtsFlow = t->cts_flow != 0;
+    }
+    if (t->dsr_flow != SERIAL_TUNE_KEEP) {
+        dcb.fOutxDsrFlow = t->dsr_flow != 0;
+    }
+
+    if (!SetCommState(h, &dcb)) {
+        return FALSE;
+    }
+
+    memset(&timeouts, 0, sizeof(timeouts));
+    timeouts.ReadIntervalTimeout = t->read_interval;
+    timeouts.ReadTotalTimeoutConstant = t->read_constant;
+    timeouts.ReadTotalTimeoutMultiplier = t->read_multiplier;
+    timeouts.WriteTotalTimeoutConstant = t->write_constant;
+    timeouts.WriteTotalTimeoutMultiplier = t->write_multiplier;
+
+    return SetCommTimeouts(h, &timeouts);
+}
+
+/* Writes LatencyTimer into the device key of every present device whose
+   hardware ID matches vid and pid and that already has the value, i.e.
+   whose driver knows it. Call before opening the port. Needs write access
+   to the device key, which usually means running as administrator.
+   Returns the number of devices that now have the requested value. */
+
+static inline int serial_tune_latency(const char *vid, const char *pid, DWORD ms)
+{
+    HDEVINFO set;
+    SP_DEVINFO_DATA info;
+    char hardware_id[1024];
+    HKEY key;
+    DWORD current;
+    DWORD size;
+    DWORD i;
+    int count = 0;
+
+    if (ms == 0) {
+        return 0;
+    }
+
+    /* FTDI ports hang off the FTDIBUS enumerator, not USB */
+    set = SetupDiGetClassDevs(NULL, NULL, NULL, DIGCF_PRESENT | DIGCF_ALLCLASSES);
+
+    if (set == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+
+    info.cbSize = sizeof(info);
+
+    for (i = 0; SetupDiEnumDeviceInfo(set, i, &info); i++) {
+        if (!SetupDiGetDeviceRegistryProperty(set, &info, SPDRP_HARDWAREID, NULL,
+                (PBYTE) hardware_id, sizeof(hardware_id), NULL)) {
+            continue;
+        }
+
+        if (!strstr(hardware_id, vid) || !strstr(hardware_id, pid)) {
+            continue;
+        }
+
+        key = SetupDiOpenDevRegKey(set, &info, DICS_FLAG_GLOBAL, 0, DIREG_DEV,
+                KEY_QUERY_VALUE | KEY_SET_VALUE);
+
+        if (key == INVALID_HANDLE_VALUE) {
+            continue;
+        }
+
+        size = sizeof(current);
+
+        if (RegQueryValueEx(key, "LatencyTimer", NULL, NULL, (LPBYTE) &current, &size) == ERROR_SUCCESS) {
+            if (current == ms || RegSetValueEx(key, "LatencyTimer", 0, REG_DWORD,
+                    (const BYTE *) &ms, sizeof(ms)) == ERROR_SUCCESS) {
+                count++;
+            }
+        }
+
+        RegCloseKey(key);
+    }
+
+    SetupDiDestroyDeviceInfoList(set);
+
+    return count;
+}
@@ -1,8 +1,11 @@
 #include <windows.h>
 #include <stdio.h>
 #include "serialslider.h"
+#include "framedec.h"
+#include "airsynth.h"
 
 extern char comPort[13];
+extern HANDLE hPort;
 char *vid = "VID_AFF1";
 char *pid_legacy = "PID_52A4";
 char *pid_c = "PID_52A7";
@@ -11,11 +14,17 @@ char *current_pid = NULL;
 #define WIDTH 16
 #define HEIGHT 2
 #define THRESHOLD 128
+#define READ_CHUNK_MAX 64
 
 uint8_t airStatus = 0; // Air status variable
 
 const char *VERSION = "v0.3a";
 
+// LED写入延迟统计（由LED线程写入，主循环显示）
+volatile LONG64 ledWriteCount = 0;
+volatile LONG64 ledWriteTotalUs = 0;
+volatile LONG64 ledWriteMaxUs = 0;
+
 typedef enum
 {
     DEVICE_WAIT,
@@ -181,11 +190,812 @@ void DisplayAirStatus(HANDLE hConsole, uint8_t status)
     printf("└───────────────────┘");
 }
 
-int main()
+// 模拟游戏线程：在主循环持续读取的同时以约60Hz发送灯光数据，并统计每次写入的耗时
+DWORD WINAPI LedWriteThread(LPVOID param)
+{
+    const uint8_t *rgb = (const uint8_t *)param;
+    LARGE_INTEGER freq, start, end;
+    LONG64 us;
+
+    QueryPerformanceFrequency(&freq);
+
+    while (1)
+    {
+        QueryPerformanceCounter(&start);
+        slider_send_leds(rgb);
+        QueryPerformanceCounter(&end);
+
+        us = (end.QuadPart - start.QuadPart) * 1000000 / freq.QuadPart;
+        InterlockedExchangeAdd64(&ledWriteTotalUs, us);
+        InterlockedIncrement64(&ledWriteCount);
+        if (us > ledWriteMaxUs)
+        {
+            ledWriteMaxUs = us;
+        }
+
+        Sleep(16);
+    }
+    return 0;
+}
+
+void DisplayLedWriteLatency(HANDLE hConsole)
+{
+    static DWORD lastUpdate = 0;
+    LONG64 count, total, max;
+
+    if (GetTickCount() - lastUpdate < 1000)
+    {
+        return;
+    }
+    lastUpdate = GetTickCount();
+
+    count = InterlockedExchange64(&ledWriteCount, 0);
+    total = InterlockedExchange64(&ledWriteTotalUs, 0);
+    max = InterlockedExchange64(&ledWriteMaxUs, 0);
+
+    SetConsoleCursorPosition(hConsole, (COORD){0, HEIGHT + 13});
+    if (count > 0)
+    {
+        printf("LED write latency: avg %5lld us  max %5lld us  (%lld writes/s)      ", total / count, max, count);
+    }
+    else
+    {
+        printf("LED write latency: no writes                                          ");
+    }
+
+    slider_queue_stats_t stats;
+    slider_queue_get_stats(&stats);
+    SetConsoleCursorPosition(hConsole, (COORD){0, HEIGHT + 14});
+    printf("Command queue: %ld frames  %ld writes  %ld collisions  %ld full waits      ",
+           stats.enqueued, stats.batches, stats.cas_retries, stats.full_waits);
+
+    // 连接存活检测：超时断开的次数，以及最近一次从最后一帧到判定断开的时间
+    LONG linkTimeouts, detectMs;
+    slider_get_liveness_stats(&linkTimeouts, &detectMs);
+    SetConsoleCursorPosition(hConsole, (COORD){0, HEIGHT + 16});
+    printf("Link timeouts: %ld  (last detected after %ld ms)      ", linkTimeouts, detectMs);
+
+    // 从发送开始扫描命令到收到第一帧扫描数据的时间
+    LONG confirmUs, retries;
+    slider_get_scan_timing(&confirmUs, &retries);
+    SetConsoleCursorPosition(hConsole, (COORD){0, HEIGHT + 15});
+    if (confirmUs >= 0)
+    {
+        printf("Scan start confirmed in %ld us  (%ld retransmits)      ", confirmUs, retries);
+    }
+    else
+    {
+        printf("Scan start not confirmed yet                           ");
+    }
+}
+
+// 解析器自检：随机数据流分成随机长度的块交给frame_decode，结果必须与逐字节解析完全一致
+static uint8_t benchStream[1 << 20];
+
+static uint32_t benchRand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+BOOL DecoderFuzz(int rounds)
+{
+    uint32_t seed = GetTickCount();
+
+    for (int round = 0; round < rounds; round++)
+    {
+        size_t len = benchRand(&seed) % 20000 + 1;
+        frame_decoder_t a, b;
+        size_t ia = 0, ib = 0;
+
+        // 提高0xFF和0xFD出现的概率，覆盖帧头、转义和截断帧
+        for (size_t i = 0; i < len; i++)
+        {
+            uint32_t r = benchRand(&seed);
+            benchStream[i] = (r & 15) == 0 ? 0xff : (r & 15) == 1 ? 0xfd : (uint8_t)(r >> 4);
+        }
+
+        frame_decoder_reset(&a);
+        frame_decoder_reset(&b);
+
+        while (ia < len || ib < len)
+        {
+            bool doneA = false, doneB = false;
+
+            while (ia < len && !doneA)
+            {
+                size_t chunk = benchRand(&seed) % READ_CHUNK_MAX + 1;
+                if (chunk > len - ia)
+                {
+                    chunk = len - ia;
+                }
+                ia += frame_decode(&a, benchStream + ia, chunk, &doneA);
+            }
+            while (ib < len && !doneB)
+            {
+                ib += frame_decode_scalar(&b, benchStream + ib, len - ib, &doneB);
+            }
+
+            if (doneA != doneB ||
+                (doneA && (a.end != b.end || memcmp(a.data, b.data, a.end) != 0 ||
+                           frame_checksum_ok(&a) != frame_checksum_ok(&b))))
+            {
+                printf("Decoder mismatch in round %d at offset %u\n", round, (unsigned)ia);
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+// 用滑条扫描帧（33字节payload）组成的数据流测试解析速度
+void DecoderBench(void)
+{
+    uint32_t seed = 1;
+    size_t len = 0;
+    int frames = 0;
+    LARGE_INTEGER freq, start, end;
+
+    while (len + 80 < sizeof(benchStream))
+    {
+        uint8_t frame[36];
+        uint8_t sum = 0xff;
+
+        frame[0] = SLIDER_CMD_AUTO_SCAN;
+        frame[1] = 33;
+        for (int i = 0; i < 33; i++)
+        {
+            frame[2 + i] = (uint8_t)benchRand(&seed);
+        }
+        for (int i = 0; i < 35; i++)
+        {
+            sum += frame[i];
+        }
+        frame[35] = sum;
+
+        benchStream[len++] = 0xff;
+        for (int i = 0; i < 36; i++)
+        {
+            if (frame[i] == 0xff || frame[i] == 0xfd)
+            {
+                benchStream[len++] = 0xfd;
+                benchStream[len++] = frame[i] - 1;
+            }
+            else
+            {
+                benchStream[len++] = frame[i];
+            }
+        }
+        frames++;
+    }
+
+    QueryPerformanceFrequency(&freq);
+
+    for (int simd = 0; simd < 2; simd++)
+    {
+        // 整段回放，以及每次只读到一帧左右数据（约1kHz回报率时的情况）
+        for (int perFrame = 0; perFrame < 2; perFrame++)
+        {
+            size_t chunk = perFrame ? 40 : len;
+            int got = 0, bad = 0;
+
+            QueryPerformanceCounter(&start);
+            for (int rep = 0; rep < 20; rep++)
+            {
+                frame_decoder_t d;
+                size_t i = 0;
+
+                frame_decoder_reset(&d);
+                while (i < len)
+                {
+                    size_t n = len - i < chunk ? len - i : chunk;
+                    size_t end = i + n;
+                    while (i < end)
+                    {
+                        bool done;
+                        i += simd ? frame_decode(&d, benchStream + i, end - i, &done)
+                                  : frame_decode_scalar(&d, benchStream + i, end - i, &done);
+                        if (done)
+                        {
+                            got++;
+                            bad += !frame_checksum_ok(&d);
+                        }
+                    }
+                }
+            }
+            QueryPerformanceCounter(&end);
+
+            double seconds = (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+            printf("%-6s %-7s %8d frames  %4d bad  %7.1f MB/s  %6.1f ns/frame\n",
+                   simd ? "chunk" : "scalar", perFrame ? "40 B" : "bulk", got, bad,
+                   len * 20 / seconds / 1e6, seconds * 1e9 / got);
+        }
+    }
+}
+
+int RunDecoderBench(void)
+{
+    printf("Frame decoder self test... ");
+    if (!DecoderFuzz(2000))
+    {
+        return 1;
+    }
+    printf("OK\n");
+    DecoderBench();
+    return 0;
+}
+
+// 天键判定模拟：游戏以60Hz轮询光束，手台在两次轮询之间的随机时刻上报“整排遮挡”。
+// 判定模型（近似）：被遮挡的光束必须从最低一条开始连续，且两次轮询之间高度变化不超过AIR_JUDGE_MAX_JUMP条，
+// 否则视为miss；高度第一次上升的那次轮询视为检测到抬手。
+#define AIR_POLL_US 16667
+#define AIR_JUDGE_MAX_JUMP 3
+#define AIR_TRIALS 10000
+
+static int AirHeight(uint8_t beams)
+{
+    int height = 0;
+
+    while (height < 6 && (beams & (1 << height)))
+    {
+        height++;
+    }
+    // 不连续的遮挡没有对应的高度
+    return beams == (uint8_t)((1 << height) - 1) ? height : -1;
+}
+
+void AirBench(void)
+{
+    uint32_t seed = 1;
+
+    printf("step  misses  detect avg/max (ms)  full raise avg (ms)\n");
+
+    for (int step = 0; step <= 6; step++)
+    {
+        int misses = 0;
+        double detectSum = 0, detectMax = 0, fullSum = 0;
+
+        for (int trial = 0; trial < AIR_TRIALS; trial++)
+        {
+            air_synth_t synth;
+            // 边沿发生在两次轮询之间的随机位置
+            double edge = (double)(benchRand(&seed) % AIR_POLL_US) / 1000.0;
+            double detect = -1, full = -1;
+            int last = 0;
+            bool miss = false;
+
+            air_synth_init(&synth, step);
+
+            for (int poll = 1; poll <= 12; poll++)
+            {
+                double t = poll * AIR_POLL_US / 1000.0;
+                uint8_t raw = t >= edge ? 0x3f : 0x00;
+                // step为0时直接转发手台状态（原来的行为）
+                int height = AirHeight(step == 0 ? raw : air_synth_poll(&synth, raw));
+
+                if (height < 0 || height - last > AIR_JUDGE_MAX_JUMP || last - height > AIR_JUDGE_MAX_JUMP)
+                {
+                    miss = true;
+                }
+                if (detect < 0 && height > last)
+                {
+                    detect = t - edge;
+                }
+                if (full < 0 && height == 6)
+                {
+                    full = t - edge;
+                }
+                last = height < 0 ? last : height;
+            }
+
+            misses += miss;
+            detectSum += detect;
+            fullSum += full;
+            if (detect > detectMax)
+            {
+                detectMax = detect;
+            }
+        }
+
+        char label[8];
+        snprintf(label, sizeof(label), step ? "%d" : "raw", step);
+        printf("%-5s %6d  %8.1f / %5.1f       %8.1f\n", label,
+               misses, detectSum / AIR_TRIALS, detectMax, fullSum / AIR_TRIALS);
+    }
+}
+
+// --alloc-check：加载chuniio_affine.dll，把它导入表中的堆分配、建线程和创建同步对象的函数
+// 换成计数的版本。预热一次开始/停止之后，反复开始/停止滑条、轮询JVS并发送灯光数据，
+// 这期间只要调用过其中任何一个函数即为失败。需要连接控制器。
+#define ALLOC_CHECK_CYCLES 20
+
+typedef struct AllocHook
+{
+    const char *name;
+    void *hook;
+    void *real;
+    volatile LONG calls;
+} AllocHook;
+
+static volatile LONG allocArmed;
+static volatile LONG allocFrames;
+
+static void *__cdecl HookMalloc(size_t size);
+static void *__cdecl HookCalloc(size_t count, size_t size);
+static void *__cdecl HookRealloc(void *ptr, size_t size);
+static char *__cdecl HookStrdup(const char *str);
+static LPVOID WINAPI HookHeapAlloc(HANDLE heap, DWORD flags, SIZE_T size);
+static uintptr_t __cdecl HookBeginThreadEx(void *security, unsigned stack, unsigned (__stdcall *proc)(void *), void *arg, unsigned flags, unsigned *id);
+static HANDLE WINAPI HookCreateThread(LPSECURITY_ATTRIBUTES attr, SIZE_T stack, LPTHREAD_START_ROUTINE proc, LPVOID arg, DWORD flags, LPDWORD id);
+static void WINAPI HookInitializeCriticalSection(LPCRITICAL_SECTION cs);
+static HANDLE WINAPI HookCreateEventA(LPSECURITY_ATTRIBUTES attr, BOOL manual, BOOL initial, LPCSTR name);
+static HANDLE WINAPI HookCreateEventW(LPSECURITY_ATTRIBUTES attr, BOOL manual, BOOL initial, LPCWSTR name);
+
+enum
+{
+    HOOK_MALLOC,
+    HOOK_CALLOC,
+    HOOK_REALLOC,
+    HOOK_STRDUP,
+    HOOK_HEAP_ALLOC,
+    HOOK_BEGIN_THREAD,
+    HOOK_CREATE_THREAD,
+    HOOK_INIT_CS,
+    HOOK_CREATE_EVENT_A,
+    HOOK_CREATE_EVENT_W,
+    HOOK_COUNT
+};
+
+static AllocHook allocHooks[HOOK_COUNT] = {
+    {"malloc", (void *)HookMalloc},
+    {"calloc", (void *)HookCalloc},
+    {"realloc", (void *)HookRealloc},
+    {"_strdup", (void *)HookStrdup},
+    {"HeapAlloc", (void *)HookHeapAlloc},
+    {"_beginthreadex", (void *)HookBeginThreadEx},
+    {"CreateThread", (void *)HookCreateThread},
+    {"InitializeCriticalSection", (void *)HookInitializeCriticalSection},
+    {"CreateEventA", (void *)HookCreateEventA},
+    {"CreateEventW", (void *)HookCreateEventW},
+};
+
+static void AllocCount(int hook)
+{
+    if (allocArmed)
+    {
+        InterlockedIncrement(&allocHooks[hook].calls);
+    }
+}
+
+static void *__cdecl HookMalloc(size_t size)
+{
+    AllocCount(HOOK_MALLOC);
+    return ((void *(__cdecl *)(size_t))allocHooks[HOOK_MALLOC].real)(size);
+}
+
+static void *__cdecl HookCalloc(size_t count, size_t size)
+{
+    AllocCount(HOOK_CALLOC);
+    return ((void *(__cdecl *)(size_t, size_t))allocHooks[HOOK_CALLOC].real)(count, size);
+}
+
+static void *__cdecl HookRealloc(void *ptr, size_t size)
+{
+    AllocCount(HOOK_REALLOC);
+    return ((void *(__cdecl *)(void *, size_t))allocHooks[HOOK_REALLOC].real)(ptr, size);
+}
+
+static char *__cdecl HookStrdup(const char *str)
+{
+    AllocCount(HOOK_STRDUP);
+    return ((char *(__cdecl *)(const char *))allocHooks[HOOK_STRDUP].real)(str);
+}
+
+static LPVOID WINAPI HookHeapAlloc(HANDLE heap, DWORD flags, SIZE_T size)
+{
+    AllocCount(HOOK_HEAP_ALLOC);
+    return ((LPVOID (WINAPI *)(HANDLE, DWORD, SIZE_T))allocHooks[HOOK_HEAP_ALLOC].real)(heap, flags, size);
+}
+
+static uintptr_t __cdecl HookBeginThreadEx(void *security, unsigned stack, unsigned (__stdcall *proc)(void *), void *arg, unsigned flags, unsigned *id)
+{
+    AllocCount(HOOK_BEGIN_THREAD);
+    return ((uintptr_t (__cdecl *)(void *, unsigned, unsigned (__stdcall *)(void *), void *, unsigned, unsigned *))allocHooks[HOOK_BEGIN_THREAD].real)(security, stack, proc, arg, flags, id);
+}
+
+static HANDLE WINAPI HookCreateThread(LPSECURITY_ATTRIBUTES attr, SIZE_T stack, LPTHREAD_START_ROUTINE proc, LPVOID arg, DWORD flags, LPDWORD id)
+{
+    AllocCount(HOOK_CREATE_THREAD);
+    return ((HANDLE (WINAPI *)(LPSECURITY_ATTRIBUTES, SIZE_T, LPTHREAD_START_ROUTINE, LPVOID, DWORD, LPDWORD))allocHooks[HOOK_CREATE_THREAD].real)(attr, stack, proc, arg, flags, id);
+}
+
+static void WINAPI HookInitializeCriticalSection(LPCRITICAL_SECTION cs)
+{
+    AllocCount(HOOK_INIT_CS);
+    ((void (WINAPI *)(LPCRITICAL_SECTION))allocHooks[HOOK_INIT_CS].real)(cs);
+}
+
+static HANDLE WINAPI HookCreateEventA(LPSECURITY_ATTRIBUTES attr, BOOL manual, BOOL initial, LPCSTR name)
+{
+    AllocCount(HOOK_CREATE_EVENT_A);
+    return ((HANDLE (WINAPI *)(LPSECURITY_ATTRIBUTES, BOOL, BOOL, LPCSTR))allocHooks[HOOK_CREATE_EVENT_A].real)(attr, manual, initial, name);
+}
+
+static HANDLE WINAPI HookCreateEventW(LPSECURITY_ATTRIBUTES attr, BOOL manual, BOOL initial, LPCWSTR name)
+{
+    AllocCount(HOOK_CREATE_EVENT_W);
+    return ((HANDLE (WINAPI *)(LPSECURITY_ATTRIBUTES, BOOL, BOOL, LPCWSTR))allocHooks[HOOK_CREATE_EVENT_W].real)(attr, manual, initial, name);
+}
+
+// 替换模块导入表中同名的函数，返回替换的个数
+static int PatchImports(HMODULE module)
+{
+    BYTE *base = (BYTE *)module;
+    IMAGE_NT_HEADERS *nt = (IMAGE_NT_HEADERS *)(base + ((IMAGE_DOS_HEADER *)base)->e_lfanew);
+    IMAGE_DATA_DIRECTORY *dir = &nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+    IMAGE_IMPORT_DESCRIPTOR *imp;
+    int patched = 0;
+
+    if (dir->VirtualAddress == 0)
+    {
+        return 0;
+    }
+
+    for (imp = (IMAGE_IMPORT_DESCRIPTOR *)(base + dir->VirtualAddress); imp->Name != 0; imp++)
+    {
+        IMAGE_THUNK_DATA *names = (IMAGE_THUNK_DATA *)(base + (imp->OriginalFirstThunk ? imp->OriginalFirstThunk : imp->FirstThunk));
+        IMAGE_THUNK_DATA *funcs = (IMAGE_THUNK_DATA *)(base + imp->FirstThunk);
+
+        for (; names->u1.AddressOfData != 0; names++, funcs++)
+        {
+            IMAGE_IMPORT_BY_NAME *byName;
+            DWORD protect;
+
+            if (IMAGE_SNAP_BY_ORDINAL(names->u1.Ordinal))
+            {
+                continue;
+            }
+
+            byName = (IMAGE_IMPORT_BY_NAME *)(base + names->u1.AddressOfData);
+
+            for (int i = 0; i < HOOK_COUNT; i++)
+            {
+                if (strcmp((const char *)byName->Name, allocHooks[i].name) != 0)
+                {
+                    continue;
+                }
+
+                VirtualProtect(&funcs->u1.Function, sizeof(funcs->u1.Function), PAGE_READWRITE, &protect);
+                allocHooks[i].real = (void *)funcs->u1.Function;
+                funcs->u1.Function = (ULONG_PTR)allocHooks[i].hook;
+                VirtualProtect(&funcs->u1.Function, sizeof(funcs->u1.Function), protect, &protect);
+                patched++;
+            }
+        }
+    }
+
+    return patched;
+}
+
+static void AllocCheckCallback(const uint8_t *state)
+{
+    InterlockedIncrement(&allocFrames);
+}
+
+static int RunAllocCheck(void)
+{
+    HRESULT (*jvsInit)(void);
+    HRESULT (*sliderInit)(void);
+    void (*sliderStart)(void (*)(const uint8_t *));
+    void (*sliderStop)(void);
+    void (*jvsPoll)(uint8_t *, uint8_t *);
+    void (*setLeds)(const uint8_t *);
+    HMODULE dll = LoadLibraryA("chuniio_affine.dll");
+    uint8_t rgb[96] = {0};
+    uint8_t opbtn;
+    uint8_t beams;
+    LONG framesBefore;
+    LONG total = 0;
+    int patched;
+
+    if (dll == NULL)
+    {
+        printf("Can't load chuniio_affine.dll (%lu)\n", GetLastError());
+        return 1;
+    }
+
+    jvsInit = (HRESULT (*)(void))GetProcAddress(dll, "chuni_io_jvs_init");
+    sliderInit = (HRESULT (*)(void))GetProcAddress(dll, "chuni_io_slider_init");
+    sliderStart = (void (*)(void (*)(const uint8_t *)))GetProcAddress(dll, "chuni_io_slider_start");
+    sliderStop = (void (*)(void))GetProcAddress(dll, "chuni_io_slider_stop");
+    jvsPoll = (void (*)(uint8_t *, uint8_t *))GetProcAddress(dll, "chuni_io_jvs_poll");
+    setLeds = (void (*)(const uint8_t *))GetProcAddress(dll, "chuni_io_slider_set_leds");
+
+    if (!jvsInit || !sliderInit || !sliderStart || !sliderStop || !jvsPoll || !setLeds)
+    {
+        printf("chuniio_affine.dll is missing exports\n");
+        return 1;
+    }
+
+    patched = PatchImports(dll);
+    printf("%d imports hooked\n", patched);
+
+    jvsInit();
+    sliderInit();
+
+    // 预热：第一次开始时创建读取线程和事件
+    sliderStart(AllocCheckCallback);
+    Sleep(500);
+    sliderStop();
+    sliderStart(AllocCheckCallback);
+    Sleep(200);
+
+    if (allocFrames == 0)
+    {
+        printf("No slider frames, is the controller connected?\n");
+        sliderStop();
+        return 1;
+    }
+
+    framesBefore = allocFrames;
+    InterlockedExchange(&allocArmed, 1);
+
+    for (int cycle = 0; cycle < ALLOC_CHECK_CYCLES; cycle++)
+    {
+        for (int i = 0; i < 10; i++)
+        {
+            jvsPoll(&opbtn, &beams);
+            setLeds(rgb);
+            Sleep(10);
+        }
+
+        sliderStop();
+        Sleep(20);
+        sliderStart(AllocCheckCallback);
+    }
+
+    InterlockedExchange(&allocArmed, 0);
+    sliderStop();
+
+    printf("%d start/stop cycles, %ld frames\n", ALLOC_CHECK_CYCLES, allocFrames - framesBefore);
+
+    for (int i = 0; i < HOOK_COUNT; i++)
+    {
+        if (allocHooks[i].real != NULL)
+        {
+            printf("%-26s %ld\n", allocHooks[i].name, allocHooks[i].calls);
+        }
+        total += allocHooks[i].calls;
+    }
+
+    if (total != 0)
+    {
+        printf("FAIL: %ld calls after warm-up\n", total);
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
+
+// --tune-bench：用同一块控制器依次测试几组串口驱动参数（serialtune.h），
+// 每组重新打开串口并开始扫描，统计滑条帧的帧率、帧间隔和没有读到数据的serial_read_cmd次数。
+// 没有模拟器，结果就是这块板子在这个驱动上的实际表现。需要连接控制器，不带手台时只统计地键帧
+#define TUNE_BENCH_WARMUP_MS 300
+#define TUNE_BENCH_MS 5000
+
+typedef struct TuneProfile
+{
+    const char *name;
+    struct serial_tune tune;
+} TuneProfile;
+
+static BOOL TuneBenchFindPort(void)
+{
+    const char *port;
+
+    current_pid = pid_legacy;
+    port = GetSerialPortByVidPid(vid, pid_legacy);
+
+    if (port[0] == 0)
+    {
+        current_pid = pid_c;
+        port = GetSerialPortByVidPid(vid, pid_c);
+    }
+
+    if (port[0] == 0)
+    {
+        current_pid = NULL;
+        return FALSE;
+    }
+
+    snprintf(comPort, sizeof(comPort), "\\\\.\\%s", port);
+    return TRUE;
+}
+
+static BOOL TuneBenchRun(const TuneProfile *profile)
+{
+    LARGE_INTEGER freq, now, last, start;
+    COMMPROP prop;
+    slider_packet_t reponse;
+    LONG64 frames = 0, idle = 0, late = 0;
+    double maxGap = 0;
+    BOOL measuring = FALSE;
+
+    slider_set_tune(&profile->tune);
+
+    if (!open_port())
+    {
+        printf("%-10s can't open %s\n", profile->name, comPort);
+        return FALSE;
+    }
+
+    memset(&prop, 0, sizeof(prop));
+    GetCommProperties(hPort, &prop);
+
+    slider_start_scan();
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    last = start;
+
+    for (;;)
+    {
+        uint8_t cmd = serial_read_cmd(&reponse);
+
+        QueryPerformanceCounter(&now);
+        double elapsed = (double)(now.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart;
+
+        if (cmd == 0xff)
+        {
+            printf("%-10s connection lost\n", profile->name);
+            close_port();
+            return FALSE;
+        }
+
+        if (!measuring && elapsed >= TUNE_BENCH_WARMUP_MS)
+        {
+            measuring = TRUE;
+            start = now;
+            last = now;
+            continue;
+        }
+
+        if (measuring && elapsed >= TUNE_BENCH_MS)
+        {
+            break;
+        }
+
+        if (!measuring)
+        {
+            continue;
+        }
+
+        if (cmd == 0xfe)
+        {
+            idle++;
+        }
+        else if (cmd == SLIDER_CMD_AUTO_SCAN)
+        {
+            double gap = (double)(now.QuadPart - last.QuadPart) * 1000.0 / freq.QuadPart;
+
+            last = now;
+            frames++;
+            late += gap > 2.0;
+            if (gap > maxGap)
+            {
+                maxGap = gap;
+            }
+        }
+    }
+
+    slider_stop_scan();
+    Sleep(50);
+    close_port();
+
+    printf("%-10s %7lu  %8.1f  %7.3f  %7.2f  %6lld  %6.2f\n",
+           profile->name, (unsigned long)prop.dwCurrentRxQueue,
+           frames * 1000.0 / TUNE_BENCH_MS,
+           frames ? (double)TUNE_BENCH_MS / frames : 0.0,
+           maxGap, late, frames ? (double)idle / frames : 0.0);
+    return TRUE;
+}
+
+int RunTuneBench(void)
+{
+    TuneProfile profiles[6];
+    int count = 0;
+
+    if (!TuneBenchFindPort())
+    {
+        printf("No controller found\n");
+        return 1;
+    }
+
+    if (!slider_queue_init())
+    {
+        printf("Can't start the serial writer thread (%lu)\n", GetLastError());
+        return 1;
+    }
+
+    // 内置默认值
+    profiles[count].name = "builtin";
+    slider_get_tune(&profiles[count].tune);
+    count++;
+
+    // segatools.ini中[serial.VID_AFF1&PID_xxxx]覆盖后的值，没有该节时与builtin相同
+    profiles[count] = profiles[0];
+    profiles[count].name = "ini";
+    serial_tune_load(&profiles[count].tune, vid, current_pid, L".\\segatools.ini");
+    count++;
+
+    // 不调用SetupComm、不改线路，只保留读写超时
+    profiles[count] = profiles[0];
+    profiles[count].name = "driver";
+    profiles[count].tune.in_queue = 0;
+    profiles[count].tune.out_queue = 0;
+    profiles[count].tune.dtr = SERIAL_TUNE_KEEP;
+    count++;
+
+    profiles[count] = profiles[0];
+    profiles[count].name = "queue256";
+    profiles[count].tune.in_queue = 256;
+    profiles[count].tune.out_queue = 256;
+    count++;
+
+    profiles[count] = profiles[0];
+    profiles[count].name = "queue64k";
+    profiles[count].tune.in_queue = 65536;
+    profiles[count].tune.out_queue = 65536;
+    count++;
+
+    // mai2io使用的超时：字节间隔1毫秒
+    profiles[count] = profiles[0];
+    profiles[count].name = "interval1";
+    profiles[count].tune.read_interval = 1;
+    profiles[count].tune.read_multiplier = 1;
+    count++;
+
+    printf("%s (%s), %d ms per profile\n", comPort, current_pid, TUNE_BENCH_MS);
+    printf("profile    rxqueue  frames/s  avg(ms)  max(ms)  >2ms    idle/frame\n");
+
+    for (int i = 0; i < count; i++)
+    {
+        if (!TuneBenchRun(&profiles[i]))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
 {
     // Set console to UTF-8 mode
     SetConsoleOutputCP(65001);
 
+    if (argc > 1 && strcmp(argv[1], "--decode-bench") == 0)
+    {
+        return RunDecoderBench();
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--air-bench") == 0)
+    {
+        AirBench();
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--alloc-check") == 0)
+    {
+        return RunAllocCheck();
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--tune-bench") == 0)
+    {
+        return RunTuneBench();
+    }
+
     slider_packet_t reponse;
     HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
     DeviceState deviceState = DEVICE_WAIT;
@@ -259,6 +1069,14 @@ int main()
         snprintf(comPort, 11, "\\\\.\\COM%d", port_num);
     }
 
+    slider_set_liveness_timeout(100);
+
+    if (!slider_queue_init())
+    {
+        printf("Can't start the serial writer thread (%lu)\n", GetLastError());
+        return 1;
+    }
+
     if (!open_port())
     {
         deviceState = DEVICE_FAIL;
@@ -286,7 +1104,7 @@ int main()
     DisplayGroundSlider(hConsole, data);
     DisplayAirStatus(hConsole, airStatus);
 
-    slider_send_leds(rgb);
+    CreateThread(NULL, 0, LedWriteThread, rgb, 0, NULL);
     package_init(&reponse);
 
     while (1)
@@ -396,7 +1214,6 @@ int main()
                 {
                     isFirstConnection = FALSE;
                 }
-                Sleep(1);
                 slider_start_air_scan();
                 slider_start_scan();
                 break;
@@ -405,6 +1222,6 @@ int main()
                 break;
             }
         }
-        slider_send_leds(rgb);
+        DisplayLedWriteLatency(hConsole);
     }
 }
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "calib.h"
+
+static void calib_stat_add(struct calib_stat *s, double x)
+{
+    double delta = x - s->mean;
+
+    s->n++;
+    s->mean += delta / s->n;
+    s->m2 += delta * (x - s->mean);
+}
+
+static double calib_stat_sd(const struct calib_stat *s)
+{
+    return s->n > 1 ? sqrt(s->m2 / (s->n - 1)) : 0.0;
+}
+
+static double calib_noise_top(const struct calib_stat *s)
+{
+    double sd = calib_stat_sd(s);
+
+    /* A perfectly flat channel still needs some margin */
+    if (sd < 1.0) {
+        sd = 1.0;
+    }
+
+    return s->mean + CALIB_TOUCH_SIGMA * sd;
+}
+
+void calib_reset(struct calib_state *cal)
+{
+    memset(cal, 0, sizeof(*cal));
+}
+
+void calib_add_noise(struct calib_state *cal, const uint8_t raw[CALIB_REGIONS])
+{
+    int i;
+
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        calib_stat_add(&cal->noise[i], raw[i]);
+    }
+}
+
+void calib_add_touch(struct calib_state *cal, const uint8_t raw[CALIB_REGIONS])
+{
+    int i;
+
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        if (raw[i] > calib_noise_top(&cal->noise[i])) {
+            calib_stat_add(&cal->touch[i], raw[i]);
+        }
+    }
+}
+
+uint64_t calib_ready_mask(const struct calib_state *cal)
+{
+    uint64_t mask = 0;
+    int i;
+
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        if (cal->touch[i].n >= CALIB_MIN_TOUCH_SAMPLES) {
+            mask |= 1ULL << i;
+        }
+    }
+
+    return mask;
+}
+
+uint64_t calib_propose(const struct calib_state *cal, uint16_t threshold[CALIB_REGIONS])
+{
+    uint64_t mask = calib_ready_mask(cal);
+    double noise_top;
+    double touch_low;
+    double value;
+    int i;
+
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        if (!(mask & (1ULL << i))) {
+            continue;
+        }
+
+        noise_top = calib_noise_top(&cal->noise[i]);
+        touch_low = cal->touch[i].mean - 2.0 * calib_stat_sd(&cal->touch[i]);
+
+        if (touch_low < noise_top) {
+            touch_low = noise_top;
+        }
+
+        value = (noise_top + touch_low) / 2.0 * CALIB_THRESHOLD_SCALE;
+
+        if (value < 1.0) {
+            value = 1.0;
+        } else if (value > 16384.0) {
+            value = 16384.0;
+        }
+
+        threshold[i] = (uint16_t) value;
+    }
+
+    return mask;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Touch threshold calibration from streamed raw sensor values.
+
+   Raw frames are fed in two phases: first with nothing touching the panel
+   (noise), then while every region is being rubbed (touch). Each region
+   keeps running mean/variance (Welford), so memory stays constant however
+   long a phase runs. The proposed threshold sits halfway between the top of
+   the noise band and the bottom of the touch band.
+
+   The engine has no I/O of its own and can be driven by any frame source. */
+
+#define CALIB_REGIONS 34
+
+/* Samples further than this many noise standard deviations above the noise
+   mean count as touches during the touch phase. */
+#define CALIB_TOUCH_SIGMA 6.0
+
+/* Raw values are 8-bit, board thresholds are 0-16384 */
+#define CALIB_THRESHOLD_SCALE 64
+
+/* Touch samples needed before a region gets a proposal */
+#define CALIB_MIN_TOUCH_SAMPLES 8
+
+struct calib_stat {
+    uint32_t n;
+    double mean;
+    double m2;
+};
+
+struct calib_state {
+    struct calib_stat noise[CALIB_REGIONS];
+    struct calib_stat touch[CALIB_REGIONS];
+};
+
+void calib_reset(struct calib_state *cal);
+void calib_add_noise(struct calib_state *cal, const uint8_t raw[CALIB_REGIONS]);
+void calib_add_touch(struct calib_state *cal, const uint8_t raw[CALIB_REGIONS]);
+
+/* Bit n set: region n has enough touch samples for a proposal */
+uint64_t calib_ready_mask(const struct calib_state *cal);
+
+/* Fill threshold[] (board units) for every region in the returned mask;
+   other entries are left untouched. */
+uint64_t calib_propose(const struct calib_state *cal, uint16_t threshold[CALIB_REGIONS]);
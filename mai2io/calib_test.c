@@ -0,0 +1,292 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "calib.h"
+
+/* Host-side check of the calibration engine with synthetic profiles. calib.c
+   has no Windows dependency, so this builds with any C compiler:
+
+       gcc -O2 calib_test.c calib.c -o calib_test -lm
+
+   Exits non-zero if any check fails. */
+
+#define NOISE_FRAMES 2000
+#define TOUCH_FRAMES 2000
+#define UNTOUCHED 0xBEEF
+
+static int failures;
+static uint32_t rng_state = 12345;
+
+static void check(bool ok, const char *what, int region)
+{
+    if (!ok) {
+        printf("FAIL: %s (region %d)\n", what, region);
+        failures++;
+    }
+}
+
+static double rng_uniform(void)
+{
+    rng_state = rng_state * 1103515245 + 12345;
+    return ((rng_state >> 8) & 0xFFFF) / 65536.0;
+}
+
+/* Roughly normal: sum of 12 uniforms has mean 6 and variance 1 */
+
+static uint8_t rng_sample(double mean, double sd)
+{
+    double x = 0.0;
+    int i;
+
+    for (i = 0; i < 12; i++) {
+        x += rng_uniform();
+    }
+
+    x = mean + (x - 6.0) * sd;
+
+    if (x < 0.0) {
+        return 0;
+    }
+    if (x > 255.0) {
+        return 255;
+    }
+
+    return (uint8_t) (x + 0.5);
+}
+
+struct profile {
+    double mean;
+    double sd;
+};
+
+/* Feed both phases. Touch frames only press the regions in touch_mask, the
+   others keep reading noise like a real panel. Returns the noise and touch
+   sample extremes per region for the checks. */
+
+static void feed(
+        struct calib_state *cal,
+        const struct profile noise[CALIB_REGIONS],
+        const struct profile touch[CALIB_REGIONS],
+        uint64_t touch_mask,
+        int touch_frames,
+        uint8_t noise_max[CALIB_REGIONS],
+        uint8_t touch_min[CALIB_REGIONS])
+{
+    uint8_t raw[CALIB_REGIONS];
+    int f;
+    int i;
+
+    calib_reset(cal);
+    memset(noise_max, 0, CALIB_REGIONS);
+    memset(touch_min, 0xFF, CALIB_REGIONS);
+
+    for (f = 0; f < NOISE_FRAMES; f++) {
+        for (i = 0; i < CALIB_REGIONS; i++) {
+            raw[i] = rng_sample(noise[i].mean, noise[i].sd);
+            if (raw[i] > noise_max[i]) {
+                noise_max[i] = raw[i];
+            }
+        }
+        calib_add_noise(cal, raw);
+    }
+
+    for (f = 0; f < touch_frames; f++) {
+        for (i = 0; i < CALIB_REGIONS; i++) {
+            if (touch_mask & (1ULL << i)) {
+                raw[i] = rng_sample(touch[i].mean, touch[i].sd);
+                if (raw[i] < touch_min[i]) {
+                    touch_min[i] = raw[i];
+                }
+            } else {
+                raw[i] = rng_sample(noise[i].mean, noise[i].sd);
+            }
+        }
+        calib_add_touch(cal, raw);
+    }
+}
+
+static void reset_thresholds(uint16_t threshold[CALIB_REGIONS])
+{
+    int i;
+
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        threshold[i] = UNTOUCHED;
+    }
+}
+
+/* Separated distributions with a different profile per region: every
+   region gets a threshold above all noise and below all touches. */
+
+static void test_separated(void)
+{
+    struct profile noise[CALIB_REGIONS];
+    struct profile touch[CALIB_REGIONS];
+    struct calib_state cal;
+    uint8_t noise_max[CALIB_REGIONS];
+    uint8_t touch_min[CALIB_REGIONS];
+    uint16_t threshold[CALIB_REGIONS];
+    uint64_t mask;
+    int i;
+
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        noise[i].mean = 10 + i;
+        noise[i].sd = 0.5 + (i % 4);
+        touch[i].mean = 150 + i;
+        touch[i].sd = 3 + (i % 5);
+    }
+
+    feed(&cal, noise, touch, (1ULL << CALIB_REGIONS) - 1, TOUCH_FRAMES, noise_max, touch_min);
+    reset_thresholds(threshold);
+    mask = calib_propose(&cal, threshold);
+
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        check(mask & (1ULL << i), "separated: region not ready", i);
+        check(threshold[i] > noise_max[i] * CALIB_THRESHOLD_SCALE, "separated: threshold inside noise", i);
+        check(threshold[i] < touch_min[i] * CALIB_THRESHOLD_SCALE, "separated: threshold inside touches", i);
+    }
+}
+
+/* Zero variance in both phases: the noise band still gets a one-unit sd, so
+   the threshold is exactly halfway between mean + CALIB_TOUCH_SIGMA and the
+   touch value. */
+
+static void test_zero_variance(void)
+{
+    struct profile noise[CALIB_REGIONS];
+    struct profile touch[CALIB_REGIONS];
+    struct calib_state cal;
+    uint8_t noise_max[CALIB_REGIONS];
+    uint8_t touch_min[CALIB_REGIONS];
+    uint16_t threshold[CALIB_REGIONS];
+    uint16_t expect;
+    uint64_t mask;
+    int i;
+
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        noise[i].mean = 20;
+        noise[i].sd = 0;
+        touch[i].mean = 100;
+        touch[i].sd = 0;
+    }
+
+    feed(&cal, noise, touch, (1ULL << CALIB_REGIONS) - 1, TOUCH_FRAMES, noise_max, touch_min);
+    reset_thresholds(threshold);
+    mask = calib_propose(&cal, threshold);
+    expect = (uint16_t) ((20 + CALIB_TOUCH_SIGMA + 100) / 2.0 * CALIB_THRESHOLD_SCALE);
+
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        check(mask & (1ULL << i), "zero variance: region not ready", i);
+        check(threshold[i] == expect, "zero variance: wrong threshold", i);
+    }
+}
+
+/* Regions never touched, or touched for fewer than CALIB_MIN_TOUCH_SAMPLES
+   frames, get no proposal and keep their old threshold. */
+
+static void test_no_touch(void)
+{
+    struct profile noise[CALIB_REGIONS];
+    struct profile touch[CALIB_REGIONS];
+    struct calib_state cal;
+    uint8_t noise_max[CALIB_REGIONS];
+    uint8_t touch_min[CALIB_REGIONS];
+    uint16_t threshold[CALIB_REGIONS];
+    uint64_t touched = 0x5555555555ULL & ((1ULL << CALIB_REGIONS) - 1);
+    uint64_t mask;
+    int i;
+
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        noise[i].mean = 30;
+        noise[i].sd = 2;
+        touch[i].mean = 180;
+        touch[i].sd = 5;
+    }
+
+    feed(&cal, noise, touch, touched, TOUCH_FRAMES, noise_max, touch_min);
+    reset_thresholds(threshold);
+    mask = calib_propose(&cal, threshold);
+
+    check(mask == touched, "no touch: wrong ready mask", -1);
+
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        if (!(touched & (1ULL << i))) {
+            check(threshold[i] == UNTOUCHED, "no touch: threshold written", i);
+        }
+    }
+
+    feed(&cal, noise, touch, (1ULL << CALIB_REGIONS) - 1, CALIB_MIN_TOUCH_SAMPLES - 1, noise_max, touch_min);
+    reset_thresholds(threshold);
+    mask = calib_propose(&cal, threshold);
+
+    check(mask == 0, "too few touches: region ready", -1);
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        check(threshold[i] == UNTOUCHED, "too few touches: threshold written", i);
+    }
+}
+
+/* Overlapping distributions. Touches inside the noise band are not counted
+   at all; a touch band that reaches down into the noise is cut off at the
+   noise top, so the threshold never drops into the noise. */
+
+static void test_overlap(void)
+{
+    struct profile noise[CALIB_REGIONS];
+    struct profile touch[CALIB_REGIONS];
+    struct calib_state cal;
+    uint8_t noise_max[CALIB_REGIONS];
+    uint8_t touch_min[CALIB_REGIONS];
+    uint16_t threshold[CALIB_REGIONS];
+    double noise_top;
+    uint64_t mask;
+    int i;
+
+    /* Same distribution in both phases: nothing clears the noise band */
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        noise[i].mean = 40;
+        noise[i].sd = 4;
+        touch[i] = noise[i];
+    }
+
+    feed(&cal, noise, touch, (1ULL << CALIB_REGIONS) - 1, TOUCH_FRAMES, noise_max, touch_min);
+    reset_thresholds(threshold);
+    mask = calib_propose(&cal, threshold);
+
+    check(mask == 0, "identical: region ready", -1);
+
+    /* Touch mean just above the noise top with a wide spread */
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        touch[i].mean = 40 + CALIB_TOUCH_SIGMA * 4 + 4;
+        touch[i].sd = 12;
+    }
+
+    feed(&cal, noise, touch, (1ULL << CALIB_REGIONS) - 1, TOUCH_FRAMES, noise_max, touch_min);
+    reset_thresholds(threshold);
+    mask = calib_propose(&cal, threshold);
+
+    for (i = 0; i < CALIB_REGIONS; i++) {
+        check(mask & (1ULL << i), "overlap: region not ready", i);
+        noise_top = cal.noise[i].mean + CALIB_TOUCH_SIGMA * sqrt(cal.noise[i].m2 / (cal.noise[i].n - 1));
+        check(threshold[i] != UNTOUCHED && threshold[i] + 1 >= noise_top * CALIB_THRESHOLD_SCALE,
+                "overlap: threshold below the noise band", i);
+        check(threshold[i] <= 16384, "overlap: threshold out of range", i);
+    }
+}
+
+int main(void)
+{
+    test_separated();
+    test_zero_variance();
+    test_no_touch();
+    test_overlap();
+
+    if (failures != 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
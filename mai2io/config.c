@@ -45,6 +45,9 @@ void mai2_io_config_load(
     cfg->vk_coin = GetPrivateProfileIntW(L"io4", L"coin", VK_F3, filename);
     cfg->vk_btn_enable = GetPrivateProfileIntW(L"button", L"enable", 1, filename);
 
+    /* Hold-off after each button edge in ms, the edge itself is reported at once. 0 disables */
+    cfg->debounce_ms = GetPrivateProfileIntW(L"button", L"debounce", 5, filename);
+
     for (i = 0; i < 9; i++)
     {
         swprintf_s(key, _countof(key), L"p1Btn%i", i + 1);
@@ -64,5 +67,36 @@ void mai2_io_config_load(
 
     cfg->debug_input_1p = GetPrivateProfileIntW(L"touch", L"p1DebugInput", 0, filename);
     cfg->debug_input_2p = GetPrivateProfileIntW(L"touch", L"p2DebugInput", 0, filename);
+    GetPrivateProfileStringW(L"touch", L"remapFile", L"", cfg->remap_file, _countof(cfg->remap_file), filename);
+
+    /* Off by default so thresholds set with the test tool are not overwritten */
+    cfg->game_sens = GetPrivateProfileIntW(L"touch", L"gameSens", 0, filename);
+    cfg->sens_neutral = GetPrivateProfileIntW(L"touch", L"sensNeutral", 8192, filename);
+
+    /* Reconnect after this many ms without a touch frame, 0 disables. Only
+       useful with firmware that streams frames continuously. */
+    cfg->liveness_timeout = GetPrivateProfileIntW(L"touch", L"livenessTimeout", 0, filename);
+
+    /* Call the game at most this many times a second per player, folding the frames in between (holddec.h). 0 disables */
+    cfg->max_rate = GetPrivateProfileIntW(L"touch", L"maxRate", 0, filename);
+
+    /* Host block written by the native Linux daemon, e.g. Z:\dev\shm\mai_io_host */
+    GetPrivateProfileStringW(L"touch", L"hostFile", L"", cfg->host_file, _countof(cfg->host_file), filename);
+
+    /* Gaps between game calls longer than this many ms are counted in the
+       telemetry block, 0 disables */
+    cfg->cadence_gap = GetPrivateProfileIntW(L"cadence", L"gapThreshold", 50, filename);
+
+    /* Kobato beams are unmapped unless set, e.g. p1Beam1=256 for Select */
+    cfg->kobato_enable = GetPrivateProfileIntW(L"kobato", L"enable", 0, filename);
+
+    for (i = 0; i < 8; i++)
+    {
+        swprintf_s(key, _countof(key), L"p1Beam%i", i + 1);
+        cfg->kobato_1p_beam[i] = GetPrivateProfileIntW(L"kobato", key, 0, filename);
+
+        swprintf_s(key, _countof(key), L"p2Beam%i", i + 1);
+        cfg->kobato_2p_beam[i] = GetPrivateProfileIntW(L"kobato", key, 0, filename);
+    }
 
 }
@@ -10,12 +10,23 @@ struct mai2_io_config {
     uint8_t vk_service;
     uint8_t vk_coin;
     bool vk_btn_enable;
+    uint32_t debounce_ms;
     uint8_t vk_1p_btn[9];
     uint8_t vk_2p_btn[9];
     bool debug_input_1p;
     bool debug_input_2p;
     uint8_t vk_1p_touch[34];
     uint8_t vk_2p_touch[34];
+    wchar_t remap_file[260];
+    bool game_sens;
+    uint16_t sens_neutral;
+    uint32_t liveness_timeout;
+    uint32_t max_rate;
+    wchar_t host_file[260];
+    uint32_t cadence_gap;
+    bool kobato_enable;
+    uint16_t kobato_1p_beam[8];
+    uint16_t kobato_2p_beam[8];
 };
 
 void mai2_io_config_load(
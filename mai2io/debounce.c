@@ -0,0 +1,45 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "debounce.h"
+
+void button_debounce_reset(struct button_debounce *d)
+{
+    memset(d, 0, sizeof(*d));
+}
+
+uint8_t button_debounce_update(struct button_debounce *d, uint8_t raw, int64_t now, int64_t hold, uint8_t *chatter)
+{
+    uint8_t expired = 0;
+    uint8_t changed;
+    uint8_t bits;
+    int b;
+
+    /* Only buttons inside a window need their deadline checked */
+    for (bits = d->held; bits != 0; bits &= bits - 1) {
+        b = __builtin_ctz(bits);
+        if (now - d->until[b] >= 0) {
+            expired |= 1 << b;
+        }
+    }
+
+    d->held &= ~expired;
+    *chatter = (raw ^ d->raw) & d->held;
+    d->raw = raw;
+    changed = (raw ^ d->out) & ~d->held;
+
+    if (changed == 0) {
+        return d->out;
+    }
+
+    d->out ^= changed;
+
+    if (hold > 0) {
+        d->held |= changed;
+        for (bits = changed; bits != 0; bits &= bits - 1) {
+            d->until[__builtin_ctz(bits)] = now + hold;
+        }
+    }
+
+    return d->out;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Leading-edge debounce for the 8 buttons of one player, packed one bit per
+   button as in mai_io_shm_1/2.
+
+   A change of a button is reported on the frame it arrives, then that
+   button ignores the raw input for the hold-off window. Presses therefore
+   get no added latency; only a bounce shortly after an edge is masked. If
+   the raw state differs from the reported one when the window ends, it is
+   taken then (and starts a new window). Raw transitions seen while a button
+   is held off are counted as chatter. */
+
+struct button_debounce {
+    uint8_t out;        /* Reported state */
+    uint8_t raw;        /* Last raw state */
+    uint8_t held;       /* Buttons inside their hold-off window */
+    int64_t until[8];   /* End of each button's window, QPC ticks */
+};
+
+void button_debounce_reset(struct button_debounce *d);
+
+/* Feed one frame taken at now. hold is the window in QPC ticks, 0 passes
+   raw through. Returns the state to report; the buttons that chattered on
+   this frame are returned in *chatter. */
+
+uint8_t button_debounce_update(struct button_debounce *d, uint8_t raw, int64_t now, int64_t hold, uint8_t *chatter);
@@ -0,0 +1,261 @@
+#include <windows.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "kobato.h"
+#include "mai2io.h"
+
+static struct mai2_io_host_shm *host_shm;
+static HANDLE host_events[2];
+static volatile LONG host_stop;
+
+static void host_publish(const uint8_t player, const uint8_t state[7])
+{
+    if (player < 1 || player > 2) {
+        return;
+    }
+
+    mai2_io_host_write(&host_shm->player[player - 1], state);
+    SetEvent(host_events[player - 1]);
+}
+
+static BOOL WINAPI host_ctrl_handler(DWORD type)
+{
+    InterlockedExchange(&host_stop, 1);
+    return TRUE;
+}
+
+/* mai2io_host.exe --poll-bench: stand in for the touch and Kobato threads
+   by creating the button mappings, wait for the DLL code to attach, then
+   time mai2_io_poll and check it made no attach calls of its own. */
+
+#define POLL_BENCH_COUNT 10000000
+
+static int host_poll_bench(void)
+{
+    LARGE_INTEGER freq;
+    LARGE_INTEGER start;
+    LARGE_INTEGER end;
+    LONG calls_before;
+    LONG calls_after;
+    bool attached;
+    DWORD wait_start;
+    int i;
+
+    CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, 2, TEXT("mai_io_shm_1"));
+    CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, 2, TEXT("mai_io_shm_2"));
+    CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, KOBATO_SHM_SIZE, KOBATO_SHM_NAME);
+
+    mai2_io_init();
+    wait_start = GetTickCount();
+
+    do {
+        Sleep(10);
+        mai2_io_get_attach_stats(&calls_before, &attached);
+    } while (!attached && GetTickCount() - wait_start < 5000);
+
+    if (!attached) {
+        printf("Button mappings not attached after 5 s\n");
+        return 1;
+    }
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+
+    for (i = 0; i < POLL_BENCH_COUNT; i++) {
+        mai2_io_poll();
+    }
+
+    QueryPerformanceCounter(&end);
+    mai2_io_get_attach_stats(&calls_after, &attached);
+
+    printf("%d polls, %.1f ns/poll, %ld attach calls before, %ld during polling\n",
+            POLL_BENCH_COUNT,
+            (double) (end.QuadPart - start.QuadPart) * 1e9 / freq.QuadPart / POLL_BENCH_COUNT,
+            calls_before, calls_after - calls_before);
+
+    if (calls_after != calls_before) {
+        printf("FAIL: mai2_io_poll made kernel calls after attaching\n");
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
+
+/* mai2io_host.exe --read-bench [seconds]: run the touch threads the way the
+   game does and time the frames they deliver. With [touch] hostFile unset
+   and no host running this measures the in-process ReadFile path; with
+   hostFile pointing at a running mai2io_daemon it measures the client side
+   of the daemon path, whose own CPU use is in the daemon's stats line.
+   Both print the same figures so the two can be compared directly. */
+
+#define READ_BENCH_TIME 10
+
+static LARGE_INTEGER read_bench_last[2];
+static volatile LONG read_bench_frames[2];
+static volatile LONG64 read_bench_max[2];
+static volatile LONG64 read_bench_sum[2];
+
+static void read_bench_frame(const uint8_t player, const uint8_t state[7])
+{
+    LARGE_INTEGER now;
+    LONG64 gap;
+
+    if (player < 1 || player > 2) {
+        return;
+    }
+
+    QueryPerformanceCounter(&now);
+
+    if (read_bench_last[player - 1].QuadPart != 0) {
+        gap = now.QuadPart - read_bench_last[player - 1].QuadPart;
+        read_bench_sum[player - 1] += gap;
+        if (gap > read_bench_max[player - 1]) {
+            read_bench_max[player - 1] = gap;
+        }
+        InterlockedIncrement(&read_bench_frames[player - 1]);
+    }
+
+    read_bench_last[player - 1] = now;
+}
+
+static uint64_t read_bench_cpu(void)
+{
+    FILETIME creation;
+    FILETIME exit;
+    FILETIME kernel;
+    FILETIME user;
+
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+
+    /* 100 ns units */
+    return ((((uint64_t) kernel.dwHighDateTime << 32) | kernel.dwLowDateTime)
+            + (((uint64_t) user.dwHighDateTime << 32) | user.dwLowDateTime)) / 10;
+}
+
+static int host_read_bench(int seconds)
+{
+    LARGE_INTEGER freq;
+    uint64_t cpu_start;
+    uint64_t cpu;
+    LONG frames;
+    LONG total = 0;
+    int i;
+
+    QueryPerformanceFrequency(&freq);
+
+    mai2_io_init();
+    mai2_io_touch_init(read_bench_frame);
+    mai2_io_touch_update(true, true);
+
+    /* Let the board connect and the scan start before counting */
+    Sleep(1000);
+
+    for (i = 0; i < 2; i++) {
+        read_bench_frames[i] = 0;
+        read_bench_sum[i] = 0;
+        read_bench_max[i] = 0;
+    }
+
+    cpu_start = read_bench_cpu();
+    Sleep(seconds * 1000);
+    cpu = read_bench_cpu() - cpu_start;
+
+    for (i = 0; i < 2; i++) {
+        frames = read_bench_frames[i];
+        total += frames;
+
+        if (frames == 0) {
+            continue;
+        }
+
+        printf("%dP: %.1f frames/s, interval avg %.3f ms, max %.3f ms\n",
+                i + 1,
+                (double) frames / seconds,
+                (double) read_bench_sum[i] * 1000.0 / freq.QuadPart / frames,
+                (double) read_bench_max[i] * 1000.0 / freq.QuadPart);
+    }
+
+    if (total == 0) {
+        printf("No frames in %d s\n", seconds);
+        return 1;
+    }
+
+    printf("%.1f us cpu/frame\n", (double) cpu / total);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    HANDLE mutex;
+    HANDLE map;
+
+    if (argc > 1 && strcmp(argv[1], "--poll-bench") == 0) {
+        return host_poll_bench();
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--read-bench") == 0) {
+        return host_read_bench(argc > 2 ? atoi(argv[2]) : READ_BENCH_TIME);
+    }
+
+    mutex = CreateMutex(NULL, FALSE, HOST_MUTEX_NAME);
+
+    if (mutex == NULL || GetLastError() == ERROR_ALREADY_EXISTS) {
+        printf("mai2io host is already running\n");
+        return 1;
+    }
+
+    map = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+            sizeof(struct mai2_io_host_shm), HOST_SHM_NAME);
+
+    if (map == NULL) {
+        printf("Can't create shared memory (%lu)\n", GetLastError());
+        return 1;
+    }
+
+    host_shm = (struct mai2_io_host_shm *) MapViewOfFile(map, FILE_MAP_ALL_ACCESS, 0, 0,
+            sizeof(struct mai2_io_host_shm));
+
+    if (host_shm == NULL) {
+        printf("Can't map shared memory (%lu)\n", GetLastError());
+        return 1;
+    }
+
+    /* The block may outlive a previous host if a game still has it mapped.
+       Mark it as ours before the touch threads start so that our own copy
+       of the IO code doesn't try to attach to it. */
+
+    host_shm->magic = 0;
+    host_shm->pid = GetCurrentProcessId();
+    host_shm->flags = 0;
+
+    host_events[0] = CreateEvent(NULL, FALSE, FALSE, HOST_EVENT_NAME_1);
+    host_events[1] = CreateEvent(NULL, FALSE, FALSE, HOST_EVENT_NAME_2);
+
+    SetConsoleCtrlHandler(host_ctrl_handler, TRUE);
+
+    /* Same configuration as the DLL, read from .\segatools.ini */
+
+    mai2_io_init();
+    mai2_io_touch_init(host_publish);
+    mai2_io_touch_update(true, true);
+
+    mai2_io_host_beat(host_shm);
+    InterlockedExchange(&host_shm->magic, HOST_MAGIC);
+    printf("mai2io host running, press Ctrl+C to exit\n");
+
+    while (!host_stop) {
+        mai2_io_host_beat(host_shm);
+        Sleep(HOST_HEARTBEAT_INTERVAL);
+    }
+
+    InterlockedExchange(&host_shm->magic, 0);
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <windows.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Resident IO host (mai2io_host.exe).
+
+   The host runs the same touch and Kobato threads the DLL would and stays up
+   across game restarts, so the boards are found, opened and scanning before
+   the game starts. Touch frames are published here; buttons keep going
+   through mai_io_shm_1/2 and mai_io_shm_kobato as before, so mai2_io_poll
+   doesn't care who owns the boards.
+
+   When the DLL finds a live host it only reads this block. Otherwise, or if
+   the host goes away later, it opens the boards itself.
+
+   Under Wine the same layout can also come from a file written by the native
+   Linux daemon (host_linux.c, see [touch] hostFile). That host can't signal
+   events or write the named button mappings, so it sets HOST_FLAG_FILE and
+   fills in the button bytes, and the client polls. The layout must stay in
+   sync with host_linux.c. */
+
+#define HOST_SHM_NAME TEXT("mai_io_host")
+#define HOST_EVENT_NAME_1 TEXT("mai_io_host_touch_1")
+#define HOST_EVENT_NAME_2 TEXT("mai_io_host_touch_2")
+#define HOST_MUTEX_NAME TEXT("mai_io_host_instance")
+
+#define HOST_MAGIC 0x4849414D /* "MAIH" */
+#define HOST_HEARTBEAT_INTERVAL 100
+#define HOST_TIMEOUT 1000
+
+#define HOST_FLAG_FILE 0x01
+
+struct mai2_io_host_player {
+    volatile LONG seq; /* odd while the host is writing */
+    uint8_t state[7];
+    uint8_t btn[2]; /* same bytes as mai_io_shm_1/2, HOST_FLAG_FILE only */
+    uint8_t reserved[3];
+};
+
+struct mai2_io_host_shm {
+    volatile LONG magic;
+    volatile DWORD pid;
+    volatile LONG heartbeat; /* bumped every HOST_HEARTBEAT_INTERVAL ms */
+    volatile LONG flags;
+    struct mai2_io_host_player player[2];
+    volatile LONG64 beat_time; /* Unix time in ms of the last heartbeat */
+};
+
+/* The heartbeat counter is timed by each reader with its own clock while
+   attached. To decide whether to attach at all, beat_time lets a client
+   check a block at once instead of waiting for the counter to move. It is
+   wall-clock time because the Linux daemon has no GetTickCount(); under
+   Wine both sides see the same system clock. */
+
+struct mai2_io_host_watch {
+    LONG beat;
+    DWORD changed;
+};
+
+static inline void mai2_io_host_write(struct mai2_io_host_player *p, const uint8_t state[7])
+{
+    InterlockedIncrement(&p->seq);
+    memcpy(p->state, state, 7);
+    InterlockedIncrement(&p->seq);
+}
+
+/* Returns the sequence number the state was read at */
+
+static inline LONG mai2_io_host_read(struct mai2_io_host_player *p, uint8_t state[7], uint8_t btn[2])
+{
+    LONG seq;
+
+    do {
+        seq = p->seq;
+        MemoryBarrier();
+        memcpy(state, p->state, 7);
+        memcpy(btn, p->btn, 2);
+        MemoryBarrier();
+    } while ((seq & 1) || seq != p->seq);
+
+    return seq;
+}
+
+static inline int64_t mai2_io_host_time_ms(void)
+{
+    FILETIME ft;
+    int64_t t;
+
+    GetSystemTimeAsFileTime(&ft);
+    t = ((int64_t) ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+
+    /* 100 ns units since 1601 */
+    return (t - 116444736000000000LL) / 10000;
+}
+
+static inline void mai2_io_host_beat(struct mai2_io_host_shm *shm)
+{
+    InterlockedExchange64(&shm->beat_time, mai2_io_host_time_ms());
+    InterlockedIncrement(&shm->heartbeat);
+}
+
+/* True if the block has a host and its last heartbeat is recent */
+
+static inline bool mai2_io_host_fresh(const struct mai2_io_host_shm *shm)
+{
+    int64_t age;
+
+    if (shm->magic != HOST_MAGIC) {
+        return false;
+    }
+
+    age = mai2_io_host_time_ms() - shm->beat_time;
+
+    return age > -HOST_TIMEOUT && age < HOST_TIMEOUT;
+}
+
+static inline void mai2_io_host_watch_init(struct mai2_io_host_watch *w, const struct mai2_io_host_shm *shm)
+{
+    w->beat = shm->heartbeat;
+    w->changed = GetTickCount();
+}
+
+static inline bool mai2_io_host_alive(const struct mai2_io_host_shm *shm, struct mai2_io_host_watch *w)
+{
+    if (shm->magic != HOST_MAGIC) {
+        return false;
+    }
+
+    if (shm->heartbeat != w->beat) {
+        w->beat = shm->heartbeat;
+        w->changed = GetTickCount();
+        return true;
+    }
+
+    return GetTickCount() - w->changed < HOST_TIMEOUT;
+}
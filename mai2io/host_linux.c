@@ -0,0 +1,431 @@
+/* Native Linux reader for running mai2io under Wine.
+
+   Wine's serial layer turns every ReadFile into a round trip through
+   wineserver, which is what the in-process touch threads do one byte at a
+   time. This daemon reads the boards with termios instead and publishes the
+   decoded frames into a file laid out like struct mai2_io_host_shm (host.h).
+   Point [touch] hostFile at the same file through a Wine drive, e.g.
+   Z:\dev\shm\mai_io_host, and the DLL reads it instead of opening COM ports.
+
+   Usage: mai2io_daemon <1P tty|-> [2P tty|-] [shm file]
+
+   The stats line printed every STATS_INTERVAL seconds is this side of the
+   benchmark: frames per second, read() calls per frame, bytes per read and
+   CPU per frame. mai2io_host.exe --read-bench measures the in-process path
+   and the client side of this one with the same figures. */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Keep in sync with host.h */
+
+#define HOST_MAGIC 0x4849414D
+#define HOST_HEARTBEAT_INTERVAL 100
+#define HOST_FLAG_FILE 0x01
+
+struct mai2_io_host_player {
+    volatile int32_t seq;
+    uint8_t state[7];
+    uint8_t btn[2];
+    uint8_t reserved[3];
+};
+
+struct mai2_io_host_shm {
+    volatile int32_t magic;
+    volatile uint32_t pid;
+    volatile int32_t heartbeat;
+    volatile int32_t flags;
+    struct mai2_io_host_player player[2];
+    volatile int64_t beat_time;
+};
+
+#define SERIAL_CMD_AUTO_SCAN 0x01
+#define SERIAL_CMD_HEART_BEAT 0x11
+
+#define BOARD_HEARTBEAT_INTERVAL 20
+#define REOPEN_INTERVAL 500
+#define STATS_INTERVAL 10
+
+struct board {
+    const char *path;
+    int fd;
+    /* Frame decoder, same framing as serial_read_cmd */
+    uint8_t frame[128];
+    int len;
+    int size;
+    int sync;
+    int esc;
+    uint64_t last_reopen;
+    uint64_t frames;
+    uint64_t reads;
+    uint64_t bytes;
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+    (void) sig;
+    stop = 1;
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Same clock as GetSystemTimeAsFileTime under Wine, see host.h */
+
+static int64_t wall_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t cpu_us(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (uint64_t) (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000
+            + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static void board_open(struct board *b)
+{
+    struct termios tio;
+
+    b->last_reopen = now_ms();
+    b->fd = open(b->path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+    if (b->fd < 0) {
+        return;
+    }
+
+    if (tcgetattr(b->fd, &tio) != 0) {
+        close(b->fd);
+        b->fd = -1;
+        return;
+    }
+
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B115200);
+    cfsetospeed(&tio, B115200);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+
+    if (tcsetattr(b->fd, TCSANOW, &tio) != 0) {
+        close(b->fd);
+        b->fd = -1;
+        return;
+    }
+
+    tcflush(b->fd, TCIOFLUSH);
+    b->sync = 0;
+    printf("%s opened\n", b->path);
+}
+
+static void board_close(struct board *b)
+{
+    if (b->fd >= 0) {
+        close(b->fd);
+        b->fd = -1;
+        printf("%s lost\n", b->path);
+    }
+}
+
+static void publish(struct mai2_io_host_player *p, const uint8_t state[7], const uint8_t btn[2])
+{
+    __atomic_add_fetch(&p->seq, 1, __ATOMIC_SEQ_CST);
+    memcpy(p->state, state, 7);
+    memcpy(p->btn, btn, 2);
+    __atomic_add_fetch(&p->seq, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Feed one byte; returns the command once a full frame is in b->frame */
+
+static int board_decode(struct board *b, uint8_t c)
+{
+    if (c == 0xff) {
+        b->sync = 1;
+        b->esc = 0;
+        b->len = 0;
+        b->size = -1;
+        return 0;
+    }
+
+    if (!b->sync) {
+        return 0;
+    }
+
+    if (c == 0xfd) {
+        b->esc = 1;
+        return 0;
+    }
+
+    if (b->esc) {
+        c++;
+        b->esc = 0;
+    }
+
+    if (b->len == 0) {
+        b->frame[b->len++] = c;
+        return 0;
+    }
+
+    if (b->size < 0) {
+        b->size = c;
+        if (b->size > (int) sizeof(b->frame) - 1) {
+            b->sync = 0;
+        }
+        return 0;
+    }
+
+    b->frame[b->len++] = c;
+
+    /* Payload plus checksum, which the DLL doesn't check either */
+    if (b->len == b->size + 2) {
+        b->sync = 0;
+        return b->frame[0];
+    }
+
+    return 0;
+}
+
+static void board_read(struct board *b, struct mai2_io_host_player *p)
+{
+    uint8_t buf[256];
+    uint8_t btn[2];
+    ssize_t n;
+    ssize_t i;
+
+    for (;;) {
+        n = read(b->fd, buf, sizeof(buf));
+
+        /* With VMIN=0 a drained tty reads 0 rather than EAGAIN. Unplugging
+           shows up as POLLHUP/POLLERR or as EIO/ENXIO here. */
+        if (n == 0 || (n < 0 && (errno == EAGAIN || errno == EINTR))) {
+            return;
+        }
+
+        if (n < 0) {
+            board_close(b);
+            return;
+        }
+
+        b->reads++;
+        b->bytes += n;
+
+        for (i = 0; i < n; i++) {
+            if (board_decode(b, buf[i]) != SERIAL_CMD_AUTO_SCAN || b->size < 10) {
+                continue;
+            }
+
+            /* key_status[2], io_status, touch[7] */
+            btn[0] = b->frame[1] | b->frame[2];
+            btn[1] = b->frame[3];
+            publish(p, &b->frame[4], btn);
+            b->frames++;
+        }
+    }
+}
+
+static void board_heartbeat(struct board *b)
+{
+    static const uint8_t frame[] = { 0xff, SERIAL_CMD_HEART_BEAT, 0x00, 0x10 };
+
+    if (write(b->fd, frame, sizeof(frame)) < 0 && errno != EAGAIN) {
+        board_close(b);
+    }
+}
+
+/* cpu is the daemon's CPU time over the interval, shared by both boards.
+   Compare cpu/frame with mai2io_host.exe --read-bench, which reports the
+   same figures for the in-process path and for the client side of this one. */
+
+static void print_stats(struct board *boards, int count, uint64_t elapsed, uint64_t cpu)
+{
+    uint64_t frames = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        frames += boards[i].frames;
+    }
+
+    for (i = 0; i < count; i++) {
+        struct board *b = &boards[i];
+
+        if (b->path == NULL) {
+            continue;
+        }
+
+        printf("%dP: %.1f frames/s, %.2f reads/frame, %.1f bytes/read, %.1f us cpu/frame\n",
+                i + 1,
+                b->frames * 1000.0 / elapsed,
+                b->frames ? (double) b->reads / b->frames : 0.0,
+                b->reads ? (double) b->bytes / b->reads : 0.0,
+                frames ? (double) cpu / frames : 0.0);
+
+        b->frames = 0;
+        b->reads = 0;
+        b->bytes = 0;
+    }
+
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    const char *shm_path = "/dev/shm/mai_io_host";
+    struct mai2_io_host_shm *shm;
+    struct board boards[2];
+    struct pollfd pfd[2];
+    int map[2];
+    uint64_t now;
+    uint64_t last_beat;
+    uint64_t last_board_beat;
+    uint64_t last_stats;
+    uint64_t last_cpu;
+    uint64_t cpu;
+    int nfds;
+    int fd;
+    int i;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <1P tty|-> [2P tty|-] [shm file]\n", argv[0]);
+        return 1;
+    }
+
+    memset(boards, 0, sizeof(boards));
+
+    for (i = 0; i < 2; i++) {
+        boards[i].fd = -1;
+        if (argc > i + 1 && strcmp(argv[i + 1], "-") != 0) {
+            boards[i].path = argv[i + 1];
+        }
+    }
+
+    if (argc > 3) {
+        shm_path = argv[3];
+    }
+
+    fd = open(shm_path, O_RDWR | O_CREAT, 0666);
+
+    if (fd < 0 || ftruncate(fd, sizeof(*shm)) != 0) {
+        perror(shm_path);
+        return 1;
+    }
+
+    shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (shm == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    shm->magic = 0;
+    shm->pid = getpid();
+    shm->flags = HOST_FLAG_FILE;
+    memset(shm->player, 0, sizeof(shm->player));
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    for (i = 0; i < 2; i++) {
+        if (boards[i].path != NULL) {
+            board_open(&boards[i]);
+        }
+    }
+
+    __atomic_store_n(&shm->beat_time, wall_ms(), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&shm->magic, HOST_MAGIC, __ATOMIC_SEQ_CST);
+    printf("mai2io daemon publishing to %s, press Ctrl+C to exit\n", shm_path);
+
+    now = now_ms();
+    last_beat = now;
+    last_board_beat = now;
+    last_stats = now;
+    last_cpu = cpu_us();
+
+    while (!stop) {
+        nfds = 0;
+
+        for (i = 0; i < 2; i++) {
+            if (boards[i].fd >= 0) {
+                pfd[nfds].fd = boards[i].fd;
+                pfd[nfds].events = POLLIN;
+                map[nfds] = i;
+                nfds++;
+            }
+        }
+
+        poll(pfd, nfds, BOARD_HEARTBEAT_INTERVAL);
+        now = now_ms();
+
+        for (i = 0; i < nfds; i++) {
+            if (pfd[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                board_close(&boards[map[i]]);
+            } else if (pfd[i].revents & POLLIN) {
+                board_read(&boards[map[i]], &shm->player[map[i]]);
+            }
+        }
+
+        for (i = 0; i < 2; i++) {
+            struct board *b = &boards[i];
+
+            if (b->path != NULL && b->fd < 0 && now - b->last_reopen >= REOPEN_INTERVAL) {
+                /* Release whatever was held when the board went away */
+                static const uint8_t idle[9];
+
+                publish(&shm->player[i], idle, idle);
+                board_open(b);
+            }
+        }
+
+        if (now - last_board_beat >= BOARD_HEARTBEAT_INTERVAL) {
+            last_board_beat = now;
+            for (i = 0; i < 2; i++) {
+                if (boards[i].fd >= 0) {
+                    board_heartbeat(&boards[i]);
+                }
+            }
+        }
+
+        if (now - last_beat >= HOST_HEARTBEAT_INTERVAL) {
+            last_beat = now;
+            __atomic_store_n(&shm->beat_time, wall_ms(), __ATOMIC_SEQ_CST);
+            __atomic_add_fetch(&shm->heartbeat, 1, __ATOMIC_SEQ_CST);
+        }
+
+        if (now - last_stats >= STATS_INTERVAL * 1000) {
+            cpu = cpu_us();
+            print_stats(boards, 2, now - last_stats, cpu - last_cpu);
+            last_stats = now;
+            last_cpu = cpu;
+        }
+    }
+
+    __atomic_store_n(&shm->magic, 0, __ATOMIC_SEQ_CST);
+    munmap(shm, sizeof(*shm));
+
+    return 0;
+}
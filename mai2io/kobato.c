@@ -0,0 +1,375 @@
+#include <windows.h>
+#include <process.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dprintf.h"
+#include "kobato.h"
+#include "serial.h"
+#include "telemetry.h"
+
+#define KOBATO_READ_CHUNK 64
+#define KOBATO_REPLY_TIMEOUT 300
+#define KOBATO_RETRY_MIN 250
+#define KOBATO_RETRY_MAX 4000
+
+static const char *kobato_vid = "VID_0483";
+static const char *kobato_pid = "PID_5740";
+
+static HANDLE kobato_thread;
+static volatile LONG kobato_stop_flag;
+static HANDLE kobato_port = INVALID_HANDLE_VALUE;
+static uint8_t *kobato_state;
+static uint32_t kobato_bad;
+
+bool kobato_decode(struct kobato_decoder *dec, uint8_t c, uint32_t *bad)
+{
+    uint8_t sum;
+    uint8_t i;
+
+    if (c == KOBATO_SYNC) {
+        if (dec->in_frame && dec->pos != 0) {
+            (*bad)++;
+        }
+        dec->in_frame = true;
+        dec->escape = false;
+        dec->pos = 0;
+        return false;
+    }
+
+    if (!dec->in_frame) {
+        return false;
+    }
+
+    if (c == KOBATO_ESC) {
+        dec->escape = true;
+        return false;
+    }
+
+    if (dec->escape) {
+        c++;
+        dec->escape = false;
+    }
+
+    if (dec->pos >= KOBATO_MAX_FRAME) {
+        dec->in_frame = false;
+        (*bad)++;
+        return false;
+    }
+
+    dec->buf[dec->pos++] = c;
+
+    if (dec->pos != dec->buf[0] + 1) {
+        return false;
+    }
+
+    dec->in_frame = false;
+    sum = 0;
+
+    for (i = 0 ; i < dec->pos - 1 ; i++) {
+        sum += dec->buf[i];
+    }
+
+    if (dec->buf[0] < 4 || sum != dec->buf[dec->pos - 1]) {
+        (*bad)++;
+        return false;
+    }
+
+    return true;
+}
+
+static bool kobato_send(uint8_t cmd, const uint8_t *payload, uint8_t len)
+{
+    uint8_t raw[KOBATO_MAX_FRAME];
+    uint8_t out[KOBATO_MAX_FRAME * 2];
+    DWORD written;
+    uint8_t sum;
+    int n;
+    int i;
+
+    raw[0] = len + 4;
+    raw[1] = 0x00;
+    raw[2] = 0x00;
+    raw[3] = cmd;
+    memcpy(&raw[4], payload, len);
+
+    sum = 0;
+    for (i = 0 ; i < len + 4 ; i++) {
+        sum += raw[i];
+    }
+    raw[len + 4] = sum;
+
+    n = 0;
+    out[n++] = KOBATO_SYNC;
+
+    for (i = 0 ; i < len + 5 ; i++) {
+        if (raw[i] == KOBATO_SYNC || raw[i] == KOBATO_ESC) {
+            out[n++] = KOBATO_ESC;
+            out[n++] = raw[i] - 1;
+        } else {
+            out[n++] = raw[i];
+        }
+    }
+
+    return WriteFile(kobato_port, out, n, &written, NULL) && written == (DWORD) n;
+}
+
+static void kobato_publish(uint8_t beams, uint8_t flags)
+{
+    if (kobato_state != NULL) {
+        kobato_state[0] = beams;
+        kobato_state[1] = flags;
+    }
+}
+
+/* Ask for the EEPROM settings and wait for the reply. Input frames that
+   arrive in the meantime are published as usual. */
+
+static bool kobato_read_settings(struct kobato_decoder *dec, uint8_t *flags)
+{
+    static const uint8_t req[] = {0x00, 0x00};
+    uint8_t buf[KOBATO_READ_CHUNK];
+    DWORD start;
+    DWORD n;
+    DWORD i;
+
+    PurgeComm(kobato_port, PURGE_RXCLEAR);
+
+    if (!kobato_send(KOBATO_CMD_EEPROM_READ, req, sizeof(req))) {
+        return false;
+    }
+
+    start = GetTickCount();
+
+    while (GetTickCount() - start < KOBATO_REPLY_TIMEOUT && !kobato_stop_flag) {
+        if (!ReadFile(kobato_port, buf, sizeof(buf), &n, NULL)) {
+            return false;
+        }
+
+        for (i = 0 ; i < n ; i++) {
+            if (!kobato_decode(dec, buf[i], &kobato_bad)) {
+                continue;
+            }
+
+            if (kobato_frame_cmd(dec) == KOBATO_CMD_EEPROM_READ &&
+                    kobato_frame_payload_len(dec) >= 3) {
+                *flags = (kobato_frame_payload(dec)[2] & 0x1E) | KOBATO_FLAG_ONLINE;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static bool kobato_set_baud(DWORD baud)
+{
+    DCB dcb = { 0 };
+
+    dcb.DCBlength = sizeof(DCB);
+
+    if (!GetCommState(kobato_port, &dcb)) {
+        return false;
+    }
+
+    dcb.BaudRate = baud;
+    dcb.ByteSize = 8;
+    dcb.Parity = NOPARITY;
+    dcb.StopBits = ONESTOPBIT;
+
+    return SetCommState(kobato_port, &dcb);
+}
+
+static void kobato_close(void)
+{
+    if (kobato_port != INVALID_HANDLE_VALUE) {
+        CloseHandle(kobato_port);
+        kobato_port = INVALID_HANDLE_VALUE;
+    }
+}
+
+static bool kobato_connect(struct kobato_decoder *dec, uint8_t *flags)
+{
+    COMMTIMEOUTS timeouts = { 0 };
+    uint8_t mode_rst[30];
+    char path[16];
+    const char *port;
+    DWORD written;
+
+    port = GetSerialPortByVidPid(kobato_vid, kobato_pid);
+
+    if (port[0] == 0) {
+        return false;
+    }
+
+    snprintf(path, sizeof(path), "\\\\.\\%s", port);
+    kobato_port = CreateFile(path, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+            OPEN_EXISTING, 0, NULL);
+
+    if (kobato_port == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    /* Return as soon as anything is buffered, otherwise after 10 ms, so the
+       stop flag is checked regularly. */
+
+    timeouts.ReadIntervalTimeout = MAXDWORD;
+    timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+    timeouts.ReadTotalTimeoutConstant = 10;
+    timeouts.WriteTotalTimeoutConstant = 100;
+    timeouts.WriteTotalTimeoutMultiplier = 10;
+
+    if (!SetCommTimeouts(kobato_port, &timeouts)) {
+        kobato_close();
+        return false;
+    }
+
+    /* Same mode reset sequence as the test tool: at both baud rates, since
+       we don't know which one the sensor is configured for. */
+
+    memset(mode_rst, 0xAF, sizeof(mode_rst));
+
+    if (!kobato_set_baud(38400) ||
+            !WriteFile(kobato_port, mode_rst, sizeof(mode_rst), &written, NULL)) {
+        kobato_close();
+        return false;
+    }
+
+    if (!kobato_set_baud(115200) ||
+            !WriteFile(kobato_port, mode_rst, sizeof(mode_rst), &written, NULL)) {
+        kobato_close();
+        return false;
+    }
+
+    if (kobato_read_settings(dec, flags)) {
+        return true;
+    }
+
+    if (kobato_set_baud(38400) && kobato_read_settings(dec, flags)) {
+        return true;
+    }
+
+    kobato_close();
+    return false;
+}
+
+static unsigned int __stdcall kobato_thread_proc(void *ctx)
+{
+    struct kobato_decoder dec;
+    uint8_t buf[KOBATO_READ_CHUNK];
+    HANDLE map;
+    uint8_t flags;
+    uint32_t bad_reported;
+    DWORD retry;
+    DWORD waited;
+    DWORD n;
+    DWORD i;
+
+    dprintf("[Affine IO] Kobato thread started\n");
+
+    map = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+            KOBATO_SHM_SIZE, KOBATO_SHM_NAME);
+
+    if (map != NULL) {
+        kobato_state = (uint8_t *) MapViewOfFile(map, FILE_MAP_ALL_ACCESS, 0,
+                0, KOBATO_SHM_SIZE);
+    }
+
+    memset(&dec, 0, sizeof(dec));
+    retry = KOBATO_RETRY_MIN;
+    flags = 0;
+    bad_reported = 0;
+
+    while (!kobato_stop_flag) {
+        if (kobato_port == INVALID_HANDLE_VALUE) {
+            if (kobato_connect(&dec, &flags)) {
+                dprintf("[Affine IO] Kobato connected, settings %02X\n", flags);
+
+                if (!(flags & KOBATO_FLAG_EXTEND)) {
+                    dprintf("[Affine IO] Kobato extend function is off, no input reports expected\n");
+                }
+
+                kobato_publish(0, flags);
+                mai2_io_telemetry_connected(MAI2_IO_DEV_KOBATO, true);
+                retry = KOBATO_RETRY_MIN;
+                continue;
+            }
+
+            /* Back off in small steps so kobato_stop() never waits long */
+
+            for (waited = 0 ; waited < retry && !kobato_stop_flag ; waited += 50) {
+                Sleep(50);
+            }
+
+            retry = retry * 2 > KOBATO_RETRY_MAX ? KOBATO_RETRY_MAX : retry * 2;
+            continue;
+        }
+
+        if (!ReadFile(kobato_port, buf, sizeof(buf), &n, NULL)) {
+            dprintf("[Affine IO] Kobato port error, attempting reconnection\n");
+            kobato_close();
+            kobato_publish(0, 0);
+            mai2_io_telemetry_connected(MAI2_IO_DEV_KOBATO, false);
+            continue;
+        }
+
+        for (i = 0 ; i < n ; i++) {
+            if (!kobato_decode(&dec, buf[i], &kobato_bad)) {
+                continue;
+            }
+
+            if (kobato_frame_cmd(&dec) == KOBATO_CMD_INPUT &&
+                    kobato_frame_payload_len(&dec) >= 1) {
+                kobato_publish(kobato_frame_payload(&dec)[0], flags);
+                mai2_io_telemetry_frame(MAI2_IO_DEV_KOBATO);
+            }
+        }
+
+        while (bad_reported != kobato_bad) {
+            mai2_io_telemetry_bad_frame(MAI2_IO_DEV_KOBATO);
+            bad_reported++;
+        }
+    }
+
+    kobato_close();
+    kobato_publish(0, 0);
+    mai2_io_telemetry_connected(MAI2_IO_DEV_KOBATO, false);
+
+    if (kobato_state != NULL) {
+        UnmapViewOfFile(kobato_state);
+        kobato_state = NULL;
+    }
+
+    if (map != NULL) {
+        CloseHandle(map);
+    }
+
+    return 0;
+}
+
+HRESULT kobato_start(void)
+{
+    if (kobato_thread != NULL) {
+        return S_FALSE;
+    }
+
+    kobato_stop_flag = 0;
+    kobato_thread = (HANDLE) _beginthreadex(NULL, 0, kobato_thread_proc, NULL, 0, NULL);
+
+    return kobato_thread != NULL ? S_OK : E_FAIL;
+}
+
+void kobato_stop(void)
+{
+    if (kobato_thread == NULL) {
+        return;
+    }
+
+    InterlockedExchange(&kobato_stop_flag, 1);
+    WaitForSingleObject(kobato_thread, INFINITE);
+    CloseHandle(kobato_thread);
+    kobato_thread = NULL;
+}
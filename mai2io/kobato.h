@@ -0,0 +1,77 @@
+#pragma once
+
+#include <windows.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Kobato IR sensor board (VID_0483 / PID_5740).
+
+   Frames use the same layout the test tool already speaks for the EEPROM
+   read:
+
+   E0 | len | dst | src | cmd | payload ... | sum
+
+   len counts every byte after itself (sum included), sum is the low byte of
+   len + dst + src + cmd + payload. 0xE0 and 0xD0 inside a frame are sent as
+   0xD0 followed by (byte - 1).
+
+   When the extend function is enabled in the sensor's EEPROM it pushes a
+   KOBATO_CMD_INPUT frame whose first payload byte is the beam bit mask. */
+
+#define KOBATO_SYNC 0xE0
+#define KOBATO_ESC 0xD0
+#define KOBATO_MAX_FRAME 64
+
+typedef enum kobato_cmd {
+    KOBATO_CMD_INPUT = 0x01,
+    KOBATO_CMD_EEPROM_READ = 0xF6,
+} kobato_cmd_t;
+
+/* Shared state published by the reader thread:
+   [0] - beam bit mask, active-high
+   [1] - KOBATO_FLAG_* (bits 1-4 mirror the EEPROM setting byte) */
+
+#define KOBATO_SHM_NAME TEXT("mai_io_shm_kobato")
+#define KOBATO_SHM_SIZE 2
+
+enum {
+    KOBATO_FLAG_ONLINE = 0x01,
+    KOBATO_FLAG_HIGH_BAUD = 0x02,
+    KOBATO_FLAG_LED = 0x04,
+    KOBATO_FLAG_REFLECT = 0x08,
+    KOBATO_FLAG_EXTEND = 0x10,
+};
+
+struct kobato_decoder {
+    uint8_t buf[KOBATO_MAX_FRAME];
+    uint8_t pos;
+    bool in_frame;
+    bool escape;
+};
+
+/* Feed one received byte. Returns true when buf holds a complete frame whose
+   checksum matched; *bad is incremented for every frame that was dropped. */
+
+bool kobato_decode(struct kobato_decoder *dec, uint8_t c, uint32_t *bad);
+
+static inline uint8_t kobato_frame_cmd(const struct kobato_decoder *dec)
+{
+    return dec->buf[3];
+}
+
+static inline const uint8_t *kobato_frame_payload(const struct kobato_decoder *dec)
+{
+    return &dec->buf[4];
+}
+
+static inline uint8_t kobato_frame_payload_len(const struct kobato_decoder *dec)
+{
+    return dec->buf[0] - 4;
+}
+
+/* Start/stop the reader thread. It owns the port, reconnects on its own with
+   a backoff and never touches the Affine board ports or threads. */
+
+HRESULT kobato_start(void);
+void kobato_stop(void);
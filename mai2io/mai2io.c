@@ -3,15 +3,24 @@
 #include <limits.h>
 #include <stdint.h>
 #include "config.h"
+#include "debounce.h"
+#include "holddec.h"
 #include "mai2io.h"
 #include "serial.h"
 #include "dprintf.h"
+#include "host.h"
+#include "kobato.h"
+#include "remap.h"
+#include "telemetry.h"
 
 #include <stdatomic.h>
 
 #define ARRAY_LENGTH 34
 #define DEFAULT_VALUE 128
 
+#define SENS_RATIO_DEFAULT 0x32
+#define SENS_COALESCE_MS 20
+
 #define SHM_NAME_1   TEXT("mai_io_shm_1")
 #define SHM_NAME_2   TEXT("mai_io_shm_2")
 #define ARRAY_SIZE 2
@@ -33,6 +42,9 @@ static char* Vid = "VID_AFF1";
 static char* Pid_1p = "PID_52A5";
 static char* Pid_2p = "PID_52A6";
 
+/* Serial driver settings per board, [serial.VID_AFF1&PID_52A5] / [serial.VID_AFF1&PID_52A6] */
+static struct serial_tune mai2_io_tune[2];
+
 static struct mai2_io_config mai2_io_cfg;
 mai2_io_touch_callback_t _callback;
 static HANDLE mai2_io_touch_1p_thread;
@@ -45,65 +57,188 @@ static uint8_t thread_flag = 0;
 static uint8_t mai2_opbtn;
 static bool mai2_io_coin;
 
-static HANDLE h_exMapFile1;
-static HANDLE h_exMapFile2;
-static uint8_t* mai_io_btn_1;
-static uint8_t* mai_io_btn_2;
+/* Button mappings as seen by mai2_io_poll. They are opened by
+   mai2_io_attach_thread_proc, which retries with backoff until every mapping
+   exists, so once attached a poll is only a few loads with no kernel calls. */
+#define ATTACH_BACKOFF_MIN 10
+#define ATTACH_BACKOFF_MAX 1000
+
+static int64_t mai2_io_debounce_hold;
+/* [touch] maxRate, one per player, used by whichever thread feeds that player */
+static struct hold_decimator mai2_io_touch_hold[2];
+static uint8_t* volatile mai_io_btn_1;
+static uint8_t* volatile mai_io_btn_2;
+static uint8_t* volatile mai_io_kobato;
+static HANDLE mai2_io_attach_thread;
+static volatile LONG mai2_io_attach_calls;
+static volatile LONG mai2_io_attached;
+
+static HANDLE mai2_io_host_file;
+static HANDLE mai2_io_host_map;
+static struct mai2_io_host_shm *mai2_io_host;
+static volatile LONG mai2_io_local_started;
+
+static unsigned int __stdcall mai2_io_touch_host_thread_proc(void *ctx);
+
+/* Latest frame per player for mai2_io_ext_get_touch. Each player has one
+   writer (its touch thread); lock is odd while it writes. */
+static volatile LONG mai2_io_ext_lock[2];
+static struct mai2_io_ext_touch mai2_io_ext[2];
+
+/* Game sensitivity writes. set_sens runs on the game's thread and only stores
+   the translated threshold and marks the point dirty; the touch thread that
+   owns the port sends all dirty points as one batch once the game has been
+   quiet for SENS_COALESCE_MS, so a sweep over every point is a single write
+   instead of 34 round trips. */
+static uint16_t sens_table[256];
+static uint16_t sens_pending[2][ARRAY_LENGTH];
+static volatile LONG64 sens_dirty[2];
+static volatile DWORD sens_last_change[2];
 
 uint16_t mai2_io_get_api_version(void)
 {
     return 0x0101;
 }
 
+/* Open one mapping if it exists yet. The handle stays open for as long as
+   the view is in use, i.e. for the life of the process. */
+
+static uint8_t *mai2_io_attach_map(LPCTSTR name, SIZE_T size) {
+    HANDLE map;
+    uint8_t *view;
+
+    InterlockedIncrement(&mai2_io_attach_calls);
+    map = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, name);
+    if (map == NULL) {
+        return NULL;
+    }
+
+    InterlockedIncrement(&mai2_io_attach_calls);
+    view = (uint8_t*)MapViewOfFile(map, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (view == NULL) {
+        CloseHandle(map);
+    }
+    return view;
+}
+
+/* The mappings are created by the touch and Kobato threads, or by another
+   process, possibly long after init. Keep trying until all of them are
+   there, backing off so a missing one costs next to nothing. */
+
+static unsigned int __stdcall mai2_io_attach_thread_proc(void *ctx) {
+    DWORD backoff = ATTACH_BACKOFF_MIN;
+    bool need_kobato = mai2_io_cfg.kobato_enable;
+
+    for (;;) {
+        if (mai_io_btn_1 == NULL) {
+            mai_io_btn_1 = mai2_io_attach_map(SHM_NAME_1, ARRAY_SIZE);
+        }
+        if (mai_io_btn_2 == NULL) {
+            mai_io_btn_2 = mai2_io_attach_map(SHM_NAME_2, ARRAY_SIZE);
+        }
+        if (need_kobato && mai_io_kobato == NULL) {
+            mai_io_kobato = mai2_io_attach_map(KOBATO_SHM_NAME, KOBATO_SHM_SIZE);
+        }
+        if (mai_io_btn_1 != NULL && mai_io_btn_2 != NULL && (!need_kobato || mai_io_kobato != NULL)) {
+            dprintf("[Affine IO] Button mappings attached\n");
+            InterlockedExchange(&mai2_io_attached, 1);
+            return 0;
+        }
+
+        Sleep(backoff);
+        if (backoff < ATTACH_BACKOFF_MAX) {
+            backoff = backoff * 2 > ATTACH_BACKOFF_MAX ? ATTACH_BACKOFF_MAX : backoff * 2;
+        }
+    }
+}
+
+void mai2_io_get_attach_stats(LONG *calls, bool *attached) {
+    *calls = mai2_io_attach_calls;
+    *attached = mai2_io_attached != 0;
+}
+
 HRESULT mai2_io_init(void)
 {
+    LARGE_INTEGER freq;
+
     dprintf("[Affine IO] Initializing Mai2IO\n");
     mai2_io_config_load(&mai2_io_cfg, L".\\segatools.ini");
+    mai2_io_telemetry_set_gap(mai2_io_cfg.cadence_gap);
+
+    mai2_io_tune[0] = serial_default_tune;
+    mai2_io_tune[1] = serial_default_tune;
+    serial_tune_load(&mai2_io_tune[0], Vid, Pid_1p, L".\\segatools.ini");
+    serial_tune_load(&mai2_io_tune[1], Vid, Pid_2p, L".\\segatools.ini");
+    serial_tune_latency(Vid, Pid_1p, mai2_io_tune[0].latency_timer);
+    serial_tune_latency(Vid, Pid_2p, mai2_io_tune[1].latency_timer);
+
+    QueryPerformanceFrequency(&freq);
+    mai2_io_debounce_hold = freq.QuadPart * mai2_io_cfg.debounce_ms / 1000;
+    hold_init(&mai2_io_touch_hold[0], mai2_io_cfg.max_rate ? freq.QuadPart / mai2_io_cfg.max_rate : 0);
+    hold_init(&mai2_io_touch_hold[1], mai2_io_cfg.max_rate ? freq.QuadPart / mai2_io_cfg.max_rate : 0);
+
+    /* Higher ratio means more sensitive, the game default maps to sensNeutral */
+    sens_table[0] = 16384;
+    for (int i = 1; i < 256; i++) {
+        uint32_t threshold = (uint32_t) mai2_io_cfg.sens_neutral * SENS_RATIO_DEFAULT / i;
+        sens_table[i] = threshold > 16384 ? 16384 : (threshold < 1 ? 1 : threshold);
+    }
     //read_json_to_threshold("curva_config.json", touch_threshold);
+
+    if (mai2_io_attach_thread == NULL) {
+        mai2_io_attach_thread = (HANDLE)_beginthreadex(NULL, 0, mai2_io_attach_thread_proc, NULL, 0, NULL);
+    }
     return S_OK;
 }
 
 HRESULT mai2_io_poll(void)
 {  
+    int64_t entered = mai2_io_telemetry_api_enter(MAI2_IO_API_POLL);
+    uint16_t btn1 = 0;
+    uint16_t btn2 = 0;
+    uint8_t *btn_1 = mai_io_btn_1;
+    uint8_t *btn_2 = mai_io_btn_2;
+    uint8_t *kobato = mai_io_kobato;
+
     mai2_opbtn = 0;
-    if (h_exMapFile1 == NULL) {
-        mai_io_btn_1 = NULL;
-        h_exMapFile1 = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, SHM_NAME_1);
-    }
-    if(h_exMapFile1 != NULL){
-        if(mai_io_btn_1 == NULL){
-            mai_io_btn_1 = (uint8_t*)MapViewOfFile(h_exMapFile1, FILE_MAP_ALL_ACCESS, 0, 0, ARRAY_SIZE);
-        }
+    if(btn_1 != NULL){
+        btn1 =  btn_1[0];
+        btn1 |=  ((btn_1[1] & 0b10000) << 4);
+        mai2_opbtn |=  (btn_1[1] & 0b111);
     }
-    if (h_exMapFile2 == NULL) {
-        mai_io_btn_2 = NULL;
-        h_exMapFile2 = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, SHM_NAME_2);
+    if(btn_2 != NULL){
+        btn2 =  btn_2[0];
+        btn2 |=  ((btn_2[1] & 0b100000) << 3);
+        mai2_opbtn |=  (btn_2[1] & 0b111);
     }
-    if(h_exMapFile2 != NULL){
-        if(mai_io_btn_2 == NULL){
-            mai_io_btn_2 = (uint8_t*)MapViewOfFile(h_exMapFile2, FILE_MAP_ALL_ACCESS, 0, 0, ARRAY_SIZE);
+    if(kobato != NULL){
+        uint8_t beams = kobato[0];
+        for (int i = 0; i < 8; i++) {
+            if (beams & (1 << i)) {
+                btn1 |= mai2_io_cfg.kobato_1p_beam[i];
+                btn2 |= mai2_io_cfg.kobato_2p_beam[i];
+            }
         }
     }
-    if(mai_io_btn_1 != NULL){
-        p1 =  mai_io_btn_1[0];
-        p1 |=  ((mai_io_btn_1[1] & 0b10000) << 4);
-        mai2_opbtn |=  (mai_io_btn_1[1] & 0b111);
-    }
-    if(mai_io_btn_2 != NULL){
-        p2 =  mai_io_btn_2[0];
-        p2 |=  ((mai_io_btn_2[1] & 0b100000) << 3);
-        mai2_opbtn |=  (mai_io_btn_2[1] & 0b111);
-    }
+    p1 = btn1;
+    p2 = btn2;
+    mai2_io_telemetry_poll_phase(entered);
+    mai2_io_telemetry_api_leave(MAI2_IO_API_POLL, entered);
     return S_OK;
 }
 
 void mai2_io_get_opbtns(uint8_t *opbtn){
+    int64_t entered = mai2_io_telemetry_api_enter(MAI2_IO_API_GET_OPBTNS);
+
     if (opbtn != NULL) {
         *opbtn = mai2_opbtn;
     }
+    mai2_io_telemetry_api_leave(MAI2_IO_API_GET_OPBTNS, entered);
 }
 
 void mai2_io_get_gamebtns(uint16_t *player1, uint16_t *player2){
+    int64_t entered = mai2_io_telemetry_api_enter(MAI2_IO_API_GET_GAMEBTNS);
+
     if (player1 != NULL) {
         *player1 = p1;
     }
@@ -111,6 +246,7 @@ void mai2_io_get_gamebtns(uint16_t *player1, uint16_t *player2){
     if (player2 != NULL) {
         *player2 = p2;
     }
+    mai2_io_telemetry_api_leave(MAI2_IO_API_GET_GAMEBTNS, entered);
     // #ifdef DEBUG
     // dprintf("[Affine IO] Player1: %x, Player2: %x\n", *player1, *player2);
     // #endif
@@ -121,13 +257,252 @@ HRESULT mai2_io_touch_init(mai2_io_touch_callback_t callback){
     return S_OK;
 }
 
+static void mai2_io_sens_store(uint8_t *bytes){
+    int player;
+    int point;
+
+    if (!mai2_io_cfg.game_sens || bytes == NULL) {
+        return;
+    }
+
+    if (bytes[1] == 'L') {
+        player = 0;
+    } else if (bytes[1] == 'R') {
+        player = 1;
+    } else {
+        return;
+    }
+
+    point = bytes[2] - 'A';
+    if (point < 0 || point >= ARRAY_LENGTH) {
+        return;
+    }
+
+    /* The game names its region; with a host-side remap the sensor behind
+       it is on another channel of the board */
+    point = touch_remap_channel(point);
+
+    sens_pending[player][point] = sens_table[bytes[4]];
+    sens_last_change[player] = GetTickCount();
+    InterlockedOr64(&sens_dirty[player], 1LL << point);
+}
+
 void mai2_io_touch_set_sens(uint8_t *bytes){
+    int64_t entered = mai2_io_telemetry_api_enter(MAI2_IO_API_TOUCH_SET_SENS);
+
+    mai2_io_sens_store(bytes);
+    mai2_io_telemetry_api_leave(MAI2_IO_API_TOUCH_SET_SENS, entered);
+}
+
+static void mai2_io_sens_flush(int player, HANDLE hPortx){
+    uint64_t mask;
+
+    if (sens_dirty[player] == 0 || GetTickCount() - sens_last_change[player] < SENS_COALESCE_MS) {
+        return;
+    }
+
+    mask = InterlockedExchange64(&sens_dirty[player], 0);
+
+    if (!serial_write_thresholds(hPortx, sens_pending[player], mask)) {
+        InterlockedOr64(&sens_dirty[player], mask);
+        return;
+    }
+
+    #ifdef DEBUG
+    dprintf("[Affine IO] %dP sensitivity written, mask %llx\n", player + 1, (unsigned long long) mask);
+    #endif
+}
+
+static int64_t mai2_io_qpc(void) {
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
 
+/* Debounced button mask for the shm, chatter goes to telemetry */
+
+static uint8_t mai2_io_debounce(struct button_debounce *d, int player, uint8_t raw, int64_t now)
+{
+    uint8_t chatter;
+    uint8_t out;
+
+    out = button_debounce_update(d, raw, now, mai2_io_debounce_hold, &chatter);
+
+    if (chatter != 0) {
+        mai2_io_telemetry_chatter(player, chatter);
+    }
+
+    return out;
+}
+
+/* Hand a frame to the game and keep a copy for the extended exports */
+
+static void mai2_io_touch_deliver(mai2_io_touch_callback_t callback, uint8_t player, const uint8_t state[7], int64_t device_qpc) {
+    struct mai2_io_ext_touch *ext = &mai2_io_ext[player - 1];
+    int api = player == 1 ? MAI2_IO_API_TOUCH_CALLBACK_1P : MAI2_IO_API_TOUCH_CALLBACK_2P;
+    int64_t host_qpc = mai2_io_telemetry_api_enter(api);
+    uint64_t touched = 0;
+    int i;
+    int j;
+
+    callback(player, state);
+    mai2_io_telemetry_api_leave(api, host_qpc);
+
+    for (i = 0; i < 7; i++) {
+        for (j = 0; j < 5; j++) {
+            if (state[i] & (1 << j)) {
+                touched |= 1ULL << (i * 5 + j);
+            }
+        }
+    }
+
+    InterlockedIncrement(&mai2_io_ext_lock[player - 1]);
+    ext->seq++;
+    memcpy(ext->state, state, 7);
+    ext->touched = touched;
+    ext->device_qpc = device_qpc;
+    ext->host_qpc = host_qpc;
+    InterlockedIncrement(&mai2_io_ext_lock[player - 1]);
+}
+
+/* Deliver a frame subject to [touch] maxRate (holddec.h) */
+
+static void mai2_io_touch_frame(mai2_io_touch_callback_t callback, uint8_t player, const uint8_t state[7], int64_t device_qpc) {
+    uint64_t frame = 0;
+    uint64_t out;
+    uint8_t held[8];
+
+    memcpy(&frame, state, 7);
+    if (!hold_add(&mai2_io_touch_hold[player - 1], &frame, 1, device_qpc, &out)) {
+        return;
+    }
+    memcpy(held, &out, 8);
+    mai2_io_touch_deliver(callback, player, held, device_qpc);
+}
+
+/* Read timeouts: deliver what was folded once the interval has passed, so
+   a release isn't held back while the board sends nothing */
+
+static void mai2_io_touch_flush(mai2_io_touch_callback_t callback, uint8_t player, int64_t now) {
+    uint64_t out;
+    uint8_t held[8];
+
+    if (!hold_flush(&mai2_io_touch_hold[player - 1], 1, now, &out)) {
+        return;
+    }
+    memcpy(held, &out, 8);
+    mai2_io_touch_deliver(callback, player, held, now);
+}
+
+/* Deliver outside the rate limit, for disconnects */
+
+static void mai2_io_touch_deliver_now(mai2_io_touch_callback_t callback, uint8_t player, const uint8_t state[7], int64_t device_qpc) {
+    uint64_t frame = 0;
+
+    memcpy(&frame, state, 7);
+    hold_force(&mai2_io_touch_hold[player - 1], &frame, 1, device_qpc);
+    mai2_io_touch_deliver(callback, player, state, device_qpc);
+}
+
+bool mai2_io_ext_get_touch(uint8_t player, struct mai2_io_ext_touch *out) {
+    volatile LONG *lock;
+    LONG seen;
+
+    if (out == NULL || player < 1 || player > 2) {
+        return false;
+    }
+
+    lock = &mai2_io_ext_lock[player - 1];
+
+    do {
+        seen = *lock;
+        MemoryBarrier();
+        *out = mai2_io_ext[player - 1];
+        MemoryBarrier();
+    } while ((seen & 1) || seen != *lock);
+
+    return out->seq != 0;
+}
+
+/* Look for a running mai2io_host.exe, or for the block the Linux daemon
+   keeps in hostFile when that is set. Our own copy of this code inside the
+   host finds its own pid there and carries on in-process. */
+
+static bool mai2_io_host_attach(void) {
+    if (mai2_io_cfg.host_file[0] != L'\0') {
+        mai2_io_host_file = CreateFileW(mai2_io_cfg.host_file, GENERIC_READ | GENERIC_WRITE,
+                FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+        if (mai2_io_host_file == INVALID_HANDLE_VALUE) {
+            dprintf("[Affine IO] Can't open host file %ls (%lu)\n", mai2_io_cfg.host_file, GetLastError());
+            mai2_io_host_file = NULL;
+            return false;
+        }
+        mai2_io_host_map = CreateFileMapping(mai2_io_host_file, NULL, PAGE_READWRITE, 0, sizeof(struct mai2_io_host_shm), NULL);
+    } else {
+        mai2_io_host_map = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, HOST_SHM_NAME);
+    }
+
+    if (mai2_io_host_map != NULL) {
+        mai2_io_host = (struct mai2_io_host_shm *)MapViewOfFile(mai2_io_host_map, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(struct mai2_io_host_shm));
+    }
+
+    /* Checked against the heartbeat time, so this doesn't wait on the
+       game's mai2_io_touch_update path */
+    if (mai2_io_host != NULL && mai2_io_host->pid != GetCurrentProcessId()
+            && mai2_io_host_fresh(mai2_io_host)) {
+        return true;
+    }
+
+    if (mai2_io_host != NULL) {
+        UnmapViewOfFile(mai2_io_host);
+        mai2_io_host = NULL;
+    }
+    if (mai2_io_host_map != NULL) {
+        CloseHandle(mai2_io_host_map);
+        mai2_io_host_map = NULL;
+    }
+    if (mai2_io_host_file != NULL) {
+        CloseHandle(mai2_io_host_file);
+        mai2_io_host_file = NULL;
+    }
+    return false;
+}
+
+/* Things the host does for us when it's running. Also called when a client
+   thread falls back after the host went away. */
+
+static void mai2_io_touch_local_init(void) {
+    if (InterlockedCompareExchange(&mai2_io_local_started, 1, 0) != 0) {
+        return;
+    }
+    if (touch_remap_init(mai2_io_cfg.remap_file)) {
+        dprintf("[Affine IO] Host-side touch remap enabled\n");
+    }
+    if (mai2_io_cfg.kobato_enable) {
+        dprintf("[Affine IO] Enabling Kobato thread\n");
+        kobato_start();
+    }
 }
 
 void mai2_io_touch_update(bool player1, bool player2) {
     if(!thread_flag){
         thread_flag = 1;
+        if (mai2_io_host_attach()) {
+            dprintf("[Affine IO] IO host found (pid %lu), attaching as client\n", mai2_io_host->pid);
+            if (mai2_io_host->flags & HOST_FLAG_FILE) {
+                /* The Linux daemon only forwards raw touch frames */
+                mai2_io_touch_local_init();
+            }
+            if (mai2_io_cfg.debug_input_1p) {
+                mai2_io_touch_1p_thread = (HANDLE)_beginthreadex(NULL, 0, mai2_io_touch_host_thread_proc, (void *)0, 0, NULL);
+            }
+            if (mai2_io_cfg.debug_input_2p) {
+                mai2_io_touch_2p_thread = (HANDLE)_beginthreadex(NULL, 0, mai2_io_touch_host_thread_proc, (void *)1, 0, NULL);
+            }
+            return;
+        }
+        mai2_io_touch_local_init();
         if (mai2_io_cfg.debug_input_1p) {
             dprintf("[Affine IO] Enabling 1P thread\n");
             mai2_io_touch_1p_thread = (HANDLE)_beginthreadex(NULL, 0, mai2_io_touch_1p_thread_proc, _callback, 0, NULL);
@@ -139,11 +514,109 @@ void mai2_io_touch_update(bool player1, bool player2) {
     }
 }
 
+/* Client side of the IO host: wait for the host to signal a new frame and
+   hand it to the game. mai2io_host.exe already applied the remap and writes
+   the buttons itself; for the Linux daemon we do both here and poll, as it
+   can't signal our events. */
+
+static unsigned int __stdcall mai2_io_touch_host_thread_proc(void *ctx){
+    int player = (int)(intptr_t)ctx;
+    bool *stop_flag = player == 0 ? &mai2_io_touch_1p_stop_flag : &mai2_io_touch_2p_stop_flag;
+    bool file_host = (mai2_io_host->flags & HOST_FLAG_FILE) != 0;
+    struct mai2_io_host_watch watch;
+    uint8_t raw[7];
+    uint8_t state[7];
+    uint8_t btn[2];
+    uint8_t *mai_io_btn = NULL;
+    struct button_debounce debounce;
+    LONG seen = -1;
+    LONG seq;
+    int64_t decoded;
+    HANDLE event = NULL;
+    HANDLE hMapFile = NULL;
+
+    dprintf("[Affine IO] %dP host client thread started\n", player + 1);
+    if (file_host) {
+        hMapFile = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, ARRAY_SIZE, player == 0 ? SHM_NAME_1 : SHM_NAME_2);
+        if (hMapFile != NULL) {
+            mai_io_btn = (uint8_t*)MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, ARRAY_SIZE);
+        }
+    } else {
+        event = OpenEvent(SYNCHRONIZE, FALSE, player == 0 ? HOST_EVENT_NAME_1 : HOST_EVENT_NAME_2);
+    }
+    mai2_io_host_watch_init(&watch, mai2_io_host);
+    button_debounce_reset(&debounce);
+
+    while (!*stop_flag) {
+        if (event != NULL) {
+            WaitForSingleObject(event, HOST_HEARTBEAT_INTERVAL);
+        } else {
+            Sleep(1);
+        }
+
+        if (!mai2_io_host_alive(mai2_io_host, &watch)) {
+            dprintf("[Affine IO] %dP: IO host stopped, opening the board in-process\n", player + 1);
+            if (event != NULL) {
+                CloseHandle(event);
+            }
+            if (mai_io_btn != NULL) {
+                UnmapViewOfFile(mai_io_btn);
+            }
+            if (hMapFile != NULL) {
+                CloseHandle(hMapFile);
+            }
+            mai2_io_touch_local_init();
+            return player == 0 ? mai2_io_touch_1p_thread_proc(_callback) : mai2_io_touch_2p_thread_proc(_callback);
+        }
+
+        seq = mai2_io_host_read(&mai2_io_host->player[player], raw, btn);
+        if (seq == seen) {
+            mai2_io_touch_flush(_callback, player + 1, mai2_io_qpc());
+            continue;
+        }
+        seen = seq;
+        decoded = mai2_io_qpc();
+
+        if (file_host) {
+            if (touch_remap_enabled()) {
+                touch_remap_apply(raw, state);
+            } else {
+                memcpy(state, raw, 7);
+            }
+            if (mai_io_btn != NULL) {
+                mai_io_btn[0] = mai2_io_debounce(&debounce, player, btn[0], decoded);
+                mai_io_btn[1] = btn[1];
+                mai2_io_telemetry_buttons(player, decoded);
+            }
+            touch_remap_poll();
+        } else {
+            memcpy(state, raw, 7);
+        }
+        mai2_io_touch_frame(_callback, player + 1, state, decoded);
+    }
+
+    if (event != NULL) {
+        CloseHandle(event);
+    }
+    if (mai_io_btn != NULL) {
+        mai_io_btn[0] = 0;
+        mai_io_btn[1] = 0;
+        mai2_io_telemetry_buttons(player, 0);
+        UnmapViewOfFile(mai_io_btn);
+    }
+    if (hMapFile != NULL) {
+        CloseHandle(hMapFile);
+    }
+    return 0;
+}
+
 static unsigned int __stdcall mai2_io_touch_1p_thread_proc(void *ctx){
     dprintf("[Affine IO] 1P thread started\n");
     mai2_io_touch_callback_t callback = ctx;
     uint8_t state[7] = {0, 0, 0, 0, 0, 0, 0};
+    struct button_debounce debounce;
     package_init(&response1);	
+    button_debounce_reset(&debounce);
     char comPort[13];
     uint8_t* mai_io_btn; 
 
@@ -168,25 +641,52 @@ static unsigned int __stdcall mai2_io_touch_1p_thread_proc(void *ctx){
     }
     dprintf("[Affine IO] 1P COM port: %s\n", comPort);
 
-    open_port(&hPort1,comPort);
+    if (open_port_tune(&hPort1, comPort, &mai2_io_tune[0])) {
+        mai2_io_telemetry_connected(MAI2_IO_DEV_1P, true);
+    }
+    DWORD last_frame = GetTickCount();
     while (!mai2_io_touch_1p_stop_flag) {
         package_init(&response1);
         uint8_t cmd = serial_read_cmd(hPort1,&response1);
+        int64_t decoded = mai2_io_qpc();
+        if (cmd == SERIAL_CMD_AUTO_SCAN) {
+            last_frame = GetTickCount();
+        } else if (mai2_io_cfg.liveness_timeout && GetTickCount() - last_frame > mai2_io_cfg.liveness_timeout) {
+            /* The handle can stay valid while the board hangs */
+            dprintf("[Affine IO] 1P no frames for %lu ms\n", GetTickCount() - last_frame);
+            cmd = 0xff;
+        }
         switch (cmd) {
 		    case SERIAL_CMD_AUTO_SCAN:{
-			    memcpy(state, response1.touch, 7);
+			    if (touch_remap_enabled()) {
+                    touch_remap_apply(response1.touch, state);
+                } else {
+                    memcpy(state, response1.touch, 7);
+                }
                 if (mai_io_btn != NULL) {
-                    mai_io_btn[0] = response1.key_status[0] | response1.key_status[1];
+                    mai_io_btn[0] = mai2_io_debounce(&debounce, 0, response1.key_status[0] | response1.key_status[1], decoded);
                     mai_io_btn[1] = response1.io_status;
+                    mai2_io_telemetry_buttons(0, decoded);
                 }
                 #ifdef DEBUG
                 dprintf("[Affine IO] Auto Scan: %02X %02X\n", mai_io_btn[0], mai_io_btn[1]);
                 #endif
-                callback(1,state);
+                mai2_io_telemetry_frame(MAI2_IO_DEV_1P);
+                mai2_io_touch_frame(callback, 1, state, decoded);
 			    break;
             }
             case 0xff:{
                 dprintf("[Affine IO] 1P port error, attempting reconnection\n");
+                mai2_io_telemetry_connected(MAI2_IO_DEV_1P, false);
+                memset(state, 0, sizeof(state));
+                mai2_io_touch_deliver_now(callback, 1, state, decoded);
+                if (mai_io_btn != NULL) {
+                    mai_io_btn[0] = 0;
+                    mai_io_btn[1] = 0;
+                    mai2_io_telemetry_buttons(0, 0);
+                }
+                button_debounce_reset(&debounce);
+                close_port(&hPort1);
                 memset(comPort,0,13);
                 while(hPort1 == NULL || hPort1 == INVALID_HANDLE_VALUE){
                     CloseHandle(hPort1);
@@ -206,11 +706,13 @@ static unsigned int __stdcall mai2_io_touch_1p_thread_proc(void *ctx){
                     #ifdef DEBUG
                     dprintf("[Affine IO] Trying 1P COM port: %s\n", comPort);
                     #endif
-                    open_port(&hPort1,comPort);
+                    open_port_tune(&hPort1, comPort, &mai2_io_tune[0]);
                     Sleep(1000);
                 }
                 
                 dprintf("[Affine IO] 1P COM port reconnected successfully\n");
+                mai2_io_telemetry_connected(MAI2_IO_DEV_1P, true);
+                last_frame = GetTickCount();
                 
                 break;
             }
@@ -218,14 +720,18 @@ static unsigned int __stdcall mai2_io_touch_1p_thread_proc(void *ctx){
                 #ifdef DEBUG
                 dprintf("[Affine IO] Unknown command received: 0x%02X\n", cmd);
                 #endif
+                mai2_io_touch_flush(callback, 1, decoded);
                 break;
         }
         serial_heart_beat(hPort1,&request1);
+        mai2_io_sens_flush(0, hPort1);
+        touch_remap_poll();
     }
     CloseHandle(hPort1);
     if (mai_io_btn != NULL) {
         mai_io_btn[0] = 0;
         mai_io_btn[1] = 0;
+        mai2_io_telemetry_buttons(0, 0);
     }
     UnmapViewOfFile(mai_io_btn);
     CloseHandle(hMapFile);
@@ -235,7 +741,9 @@ static unsigned int __stdcall mai2_io_touch_2p_thread_proc(void *ctx){
     dprintf("[Affine IO] 2P thread started\n");
     mai2_io_touch_callback_t callback = ctx;
     uint8_t state[7] = {0, 0, 0, 0, 0, 0, 0};
+    struct button_debounce debounce;
     package_init(&response2);	
+    button_debounce_reset(&debounce);
     char comPort[13];
     uint8_t* mai_io_btn; 
 
@@ -258,20 +766,47 @@ static unsigned int __stdcall mai2_io_touch_2p_thread_proc(void *ctx){
     }
     dprintf("[Affine IO] 2P COM port: %s\n", comPort);
 
-    open_port(&hPort2,comPort);
+    if (open_port_tune(&hPort2, comPort, &mai2_io_tune[1])) {
+        mai2_io_telemetry_connected(MAI2_IO_DEV_2P, true);
+    }
+    DWORD last_frame = GetTickCount();
     while (!mai2_io_touch_2p_stop_flag) {
-        switch (serial_read_cmd(hPort2,&response2)) {
+        uint8_t cmd = serial_read_cmd(hPort2,&response2);
+        int64_t decoded = mai2_io_qpc();
+        if (cmd == SERIAL_CMD_AUTO_SCAN) {
+            last_frame = GetTickCount();
+        } else if (mai2_io_cfg.liveness_timeout && GetTickCount() - last_frame > mai2_io_cfg.liveness_timeout) {
+            dprintf("[Affine IO] 2P no frames for %lu ms\n", GetTickCount() - last_frame);
+            cmd = 0xff;
+        }
+        switch (cmd) {
 		    case SERIAL_CMD_AUTO_SCAN:
-			    memcpy(state, response2.touch, 7);
+			    if (touch_remap_enabled()) {
+                    touch_remap_apply(response2.touch, state);
+                } else {
+                    memcpy(state, response2.touch, 7);
+                }
                 if (mai_io_btn != NULL) {
-                    mai_io_btn[0] = response2.key_status[0] | response2.key_status[1];
+                    mai_io_btn[0] = mai2_io_debounce(&debounce, 1, response2.key_status[0] | response2.key_status[1], decoded);
                     mai_io_btn[1] = response2.io_status;
+                    mai2_io_telemetry_buttons(1, decoded);
                 }
                 package_init(&response2);
-                callback(2,state);
+                mai2_io_telemetry_frame(MAI2_IO_DEV_2P);
+                mai2_io_touch_frame(callback, 2, state, decoded);
 			    break;
                 case 0xff:{
                     dprintf("[Affine IO] 2P port error, attempting reconnection\n");
+                    mai2_io_telemetry_connected(MAI2_IO_DEV_2P, false);
+                    memset(state, 0, sizeof(state));
+                    mai2_io_touch_deliver_now(callback, 2, state, decoded);
+                    if (mai_io_btn != NULL) {
+                        mai_io_btn[0] = 0;
+                        mai_io_btn[1] = 0;
+                        mai2_io_telemetry_buttons(1, 0);
+                    }
+                    button_debounce_reset(&debounce);
+                    close_port(&hPort2);
                     memset(comPort,0,13);
                     while(hPort2 == NULL || hPort2 == INVALID_HANDLE_VALUE){
                         CloseHandle(hPort2);
@@ -291,21 +826,27 @@ static unsigned int __stdcall mai2_io_touch_2p_thread_proc(void *ctx){
                         #ifdef DEBUG
                         dprintf("[Affine IO] Trying 2P COM port: %s\n", comPort);
                         #endif
-                        open_port(&hPort2,comPort);
+                        open_port_tune(&hPort2, comPort, &mai2_io_tune[1]);
                         Sleep(1000);
                     }
                     dprintf("[Affine IO] 2P COM port reconnected successfully\n");
+                    mai2_io_telemetry_connected(MAI2_IO_DEV_2P, true);
+                    last_frame = GetTickCount();
                     break;
                 }
             default:
+                mai2_io_touch_flush(callback, 2, decoded);
                 break;
         }
         serial_heart_beat(hPort2,&request2);
+        mai2_io_sens_flush(1, hPort2);
+        touch_remap_poll();
     }
     CloseHandle(hPort2);
     if (mai_io_btn != NULL) {
         mai_io_btn[0] = 0;
         mai_io_btn[1] = 0;
+        mai2_io_telemetry_buttons(1, 0);
     }
     UnmapViewOfFile(mai_io_btn);
     CloseHandle(hMapFile);
@@ -316,13 +857,13 @@ HRESULT mai2_io_led_init(void){
 }
 
 void mai2_io_led_set_fet_output(uint8_t board, const uint8_t *rgb) {
-
+    mai2_io_telemetry_api_leave(MAI2_IO_API_LED_FET, mai2_io_telemetry_api_enter(MAI2_IO_API_LED_FET));
 }
 
 void mai2_io_led_dc_update(uint8_t board, const uint8_t *rgb) {
-    return;
+    mai2_io_telemetry_api_leave(MAI2_IO_API_LED_DC, mai2_io_telemetry_api_enter(MAI2_IO_API_LED_DC));
 }
 
 void mai2_io_led_gs_update(uint8_t board, const uint8_t *rgb) {
-
+    mai2_io_telemetry_api_leave(MAI2_IO_API_LED_GS, mai2_io_telemetry_api_enter(MAI2_IO_API_LED_GS));
 }
\ No newline at end of file
@@ -48,6 +48,33 @@ HRESULT mai2_io_init(void);
 
 HRESULT mai2_io_poll(void);
 
+/* Not part of the segatools API. Number of OpenFileMapping/MapViewOfFile
+   calls made so far to find the button mappings, and whether all of them
+   are attached. mai2_io_poll itself never makes these calls. */
+
+void mai2_io_get_attach_stats(LONG *calls, bool *attached);
+
+/* Extended exports. Not part of the segatools API either; hooks and tools
+   can find them with GetProcAddress.
+
+   The boards don't timestamp their frames, so device_qpc is the
+   QueryPerformanceCounter value taken as soon as the frame was decoded (or
+   read from the IO host block), and host_qpc the value right before the
+   frame was handed to the game callback. */
+
+struct mai2_io_ext_touch {
+    uint32_t seq;       /* Frames so far, 0 before the first one */
+    uint8_t state[7];   /* Same bytes as the touch callback */
+    uint64_t touched;   /* Bit (n * 5 + b) set if bit b of state[n] is set */
+    int64_t device_qpc;
+    int64_t host_qpc;
+};
+
+/* Copy the latest touch frame of player 1 or 2. Returns false if none has
+   arrived yet. */
+
+bool mai2_io_ext_get_touch(uint8_t player, struct mai2_io_ext_touch *out);
+
 /* Get the state of the cabinet's operator buttons as of the last poll. See
    MAI2_IO_OPBTN enum above: this contains bit mask definitions for button
    states returned in *opbtn. All buttons are active-high.
@@ -110,8 +137,9 @@ HRESULT mai2_io_touch_init(mai2_io_touch_callback_t callback);
    bytes[4] - Ratio value to be set, within a fixed range
    bytes[5] - Footer
 
-   Example function, not actually used. The sensitivity range can be determined
-   based on the Ratio set within the game. */
+   The ratio is translated into a board threshold (see [touch] gameSens and
+   sensNeutral) and written by the thread that owns the player's port.
+   Consecutive calls are coalesced into a single batched write. */
 
 void mai2_io_touch_set_sens(uint8_t *bytes);
 
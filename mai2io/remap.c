@@ -0,0 +1,227 @@
+#include <windows.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dprintf.h"
+#include "remap.h"
+
+#define REMAP_POLL_INTERVAL 1000
+
+/* Two tables: the readers use tables[active] while a reload builds the other
+   one and then flips the index. Reloads are at least a second apart, far
+   longer than a lookup takes. */
+
+static struct touch_remap remap_tables[2];
+static volatile LONG remap_active = -1;
+static volatile LONG remap_polling;
+static wchar_t remap_path[MAX_PATH];
+static FILETIME remap_mtime;
+static DWORD remap_last_poll;
+
+static int remap_region_index(const char *label)
+{
+    int n;
+
+    if (label[0] == 0 || label[1] < '1' || label[1] > '8' || label[2] != 0) {
+        return -1;
+    }
+
+    n = label[1] - '1';
+
+    switch (label[0]) {
+        case 'A': return n;
+        case 'B': return 8 + n;
+        case 'C': return n < 2 ? 16 + n : -1;
+        case 'D': return 18 + n;
+        case 'E': return 26 + n;
+        default: return -1;
+    }
+}
+
+bool touch_remap_build(struct touch_remap *remap, const uint8_t sheet[TOUCH_REMAP_REGIONS])
+{
+    uint64_t seen = 0;
+    uint64_t out_bit;
+    int region;
+    int channel;
+    int v;
+
+    for (region = 0; region < TOUCH_REMAP_REGIONS; region++) {
+        if (sheet[region] >= TOUCH_REMAP_REGIONS || (seen & (1ULL << sheet[region]))) {
+            return false;
+        }
+        seen |= 1ULL << sheet[region];
+    }
+
+    memset(remap, 0, sizeof(*remap));
+    memcpy(remap->channel, sheet, TOUCH_REMAP_REGIONS);
+
+    for (region = 0; region < TOUCH_REMAP_REGIONS; region++) {
+        channel = sheet[region];
+        out_bit = 1ULL << ((region / 5) * 8 + region % 5);
+
+        for (v = 0; v < 32; v++) {
+            if (v & (1 << (channel % 5))) {
+                remap->lut[channel / 5][v] |= out_bit;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool remap_load_sheet(uint8_t sheet[TOUCH_REMAP_REGIONS])
+{
+    char line[256];
+    char section[32] = "";
+    char label[8];
+    uint64_t assigned = 0;
+    int channel;
+    int region;
+    FILE *file;
+
+    file = _wfopen(remap_path, L"rb");
+
+    if (file == NULL) {
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\r\n")] = 0;
+
+        if (line[0] == '[') {
+            sscanf(line, "[%31[^]]", section);
+            continue;
+        }
+
+        if (strcmp(section, "TouchSheet") != 0) {
+            continue;
+        }
+
+        if (sscanf(line, "Channel%d=%7s", &channel, label) != 2 ||
+                channel < 0 || channel >= TOUCH_REMAP_REGIONS) {
+            continue;
+        }
+
+        region = remap_region_index(label);
+
+        if (region >= 0) {
+            sheet[region] = (uint8_t) channel;
+            assigned |= 1ULL << region;
+        }
+    }
+
+    fclose(file);
+
+    return assigned == (1ULL << TOUCH_REMAP_REGIONS) - 1;
+}
+
+static bool remap_reload(void)
+{
+    uint8_t sheet[TOUCH_REMAP_REGIONS];
+    LONG next;
+
+    if (!remap_load_sheet(sheet)) {
+        dprintf("[Affine IO] Touch remap: no complete [TouchSheet] in file\n");
+        return false;
+    }
+
+    next = remap_active == 0 ? 1 : 0;
+
+    if (!touch_remap_build(&remap_tables[next], sheet)) {
+        dprintf("[Affine IO] Touch remap: sheet is not a permutation, ignored\n");
+        return false;
+    }
+
+    InterlockedExchange(&remap_active, next);
+    dprintf("[Affine IO] Touch remap loaded\n");
+
+    return true;
+}
+
+bool touch_remap_init(const wchar_t *path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+
+    if (path == NULL || path[0] == L'\0') {
+        return false;
+    }
+
+    wcsncpy(remap_path, path, MAX_PATH - 1);
+
+    if (GetFileAttributesExW(remap_path, GetFileExInfoStandard, &attr)) {
+        remap_mtime = attr.ftLastWriteTime;
+    }
+
+    remap_last_poll = GetTickCount();
+
+    return remap_reload();
+}
+
+void touch_remap_poll(void)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    DWORD now;
+
+    if (remap_path[0] == L'\0') {
+        return;
+    }
+
+    now = GetTickCount();
+
+    if (now - remap_last_poll < REMAP_POLL_INTERVAL) {
+        return;
+    }
+
+    /* Both reader threads call this, only one of them does the check */
+
+    if (InterlockedCompareExchange(&remap_polling, 1, 0) != 0) {
+        return;
+    }
+
+    remap_last_poll = now;
+
+    if (GetFileAttributesExW(remap_path, GetFileExInfoStandard, &attr) &&
+            CompareFileTime(&attr.ftLastWriteTime, &remap_mtime) != 0) {
+        remap_mtime = attr.ftLastWriteTime;
+        remap_reload();
+    }
+
+    InterlockedExchange(&remap_polling, 0);
+}
+
+bool touch_remap_enabled(void)
+{
+    return remap_active >= 0;
+}
+
+int touch_remap_channel(int region)
+{
+    if (remap_active < 0 || region < 0 || region >= TOUCH_REMAP_REGIONS) {
+        return region;
+    }
+
+    return remap_tables[remap_active].channel[region];
+}
+
+void touch_remap_apply(const uint8_t in[7], uint8_t out[7])
+{
+    const struct touch_remap *remap = &remap_tables[remap_active];
+    uint64_t bits;
+    int i;
+
+    bits = remap->lut[0][in[0] & 0x1F]
+         | remap->lut[1][in[1] & 0x1F]
+         | remap->lut[2][in[2] & 0x1F]
+         | remap->lut[3][in[3] & 0x1F]
+         | remap->lut[4][in[4] & 0x1F]
+         | remap->lut[5][in[5] & 0x1F]
+         | remap->lut[6][in[6] & 0x1F];
+
+    for (i = 0; i < 7; i++) {
+        out[i] = (uint8_t) (bits >> (i * 8));
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <windows.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Host-side touch sheet remap.
+
+   Reads the [TouchSheet] section of a curva.ini (as saved by the test tool)
+   and applies it to the 7-byte touch state on its way to the game, instead
+   of writing the sheet to the board. The board's own sheet should be left at
+   identity while this is in use, or both mappings stack.
+
+   The permutation is compiled into one 32-entry table per state byte: each
+   entry holds the output bits that the 5 input bits of that byte scatter to,
+   already laid out in the 7-byte state format. Applying it is 7 lookups and
+   ORs, with no per-bit loop. The file is re-checked once a second so a remap
+   can be tried while the game runs. */
+
+#define TOUCH_REMAP_REGIONS 34
+
+struct touch_remap {
+    uint64_t lut[7][32];
+    uint8_t channel[TOUCH_REMAP_REGIONS]; /* the sheet, region -> channel */
+};
+
+bool touch_remap_init(const wchar_t *path);
+void touch_remap_poll(void);
+bool touch_remap_enabled(void);
+void touch_remap_apply(const uint8_t in[7], uint8_t out[7]);
+
+/* Board channel that feeds game region, for sending per-region settings
+   such as the game's sensitivity to the right sensor. Returns region
+   unchanged while no remap is loaded. */
+
+int touch_remap_channel(int region);
+
+/* Compile a sheet (sheet[region] = channel) into a table. Returns false if
+   the sheet is not a permutation of 0..33. */
+
+bool touch_remap_build(struct touch_remap *remap, const uint8_t sheet[TOUCH_REMAP_REGIONS]);
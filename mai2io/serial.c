@@ -68,7 +68,28 @@ char* GetSerialPortByVidPid(const char* vid, const char* pid) {
 }
 
 
+// 串口驱动参数，默认值对应Affine的CDC板子：
+// 字节间隔超过1毫秒或总共等待5毫秒即返回，打开DTR，其余线路保持驱动默认
+const struct serial_tune serial_default_tune = {
+    .in_queue = 4096,
+    .out_queue = 4096,
+    .read_interval = 1,
+    .read_constant = 5,
+    .read_multiplier = 1,
+    .write_constant = 100,
+    .write_multiplier = 10,
+    .dtr = DTR_CONTROL_ENABLE,
+    .rts = SERIAL_TUNE_KEEP,
+    .cts_flow = SERIAL_TUNE_KEEP,
+    .dsr_flow = SERIAL_TUNE_KEEP,
+    .latency_timer = 0,
+};
+
 BOOL open_port(HANDLE *hPortx ,char* comPortx) {
+    return open_port_tune(hPortx, comPortx, &serial_default_tune);
+}
+
+BOOL open_port_tune(HANDLE *hPortx, char* comPortx, const struct serial_tune *tune) {
     // hPort1 = CreateFileA(comPort1, GENERIC_READ | GENERIC_WRITE, 0, NULL,
     //                      OPEN_EXISTING, 0, NULL);
 	if (*hPortx != INVALID_HANDLE_VALUE) {
@@ -84,37 +105,9 @@ BOOL open_port(HANDLE *hPortx ,char* comPortx) {
 		CloseHandle(*hPortx);
 		return FALSE;
 	}
-    DCB dcb = { 0 };
-    dcb.DCBlength = sizeof(DCB);
-    if (!GetCommState(*hPortx, &dcb)) {
-        CloseHandle(*hPortx);
-        return FALSE;
-    }
 
-    dcb.BaudRate = 115200;
-    dcb.ByteSize = 8;
-    dcb.Parity = NOPARITY;
-    dcb.StopBits = ONESTOPBIT;
-    dcb.fDtrControl = DTR_CONTROL_ENABLE; // 启用DTR
-
-    if (!SetCommState(*hPortx, &dcb)) {
-        CloseHandle(*hPortx);
-        return FALSE;
-    }
-
-    COMMTIMEOUTS timeouts = { 0 };
-    if (!GetCommTimeouts(*hPortx, &timeouts)) {
-        CloseHandle(*hPortx);
-        return FALSE;
-    }
-
-	timeouts.ReadIntervalTimeout = 1; // 设置读取间隔超时为1毫秒
-    timeouts.ReadTotalTimeoutConstant = 5; // 设置读取总超时常量为5毫秒
-    timeouts.ReadTotalTimeoutMultiplier = 1; // 设置读取总超时乘数为1毫秒
-    timeouts.WriteTotalTimeoutConstant = 100; // 设置写入总超时常量为100毫秒
-    timeouts.WriteTotalTimeoutMultiplier = 10; // 设置写入总超时乘数为10毫秒
-
-    if (!SetCommTimeouts(*hPortx, &timeouts)) {
+    // 队列大小、DTR/RTS、流控和超时按设备配置设置（见serialtune.h）
+    if (!serial_tune_apply(*hPortx, tune)) {
         CloseHandle(*hPortx);
         return FALSE;
     }
@@ -277,4 +270,27 @@ void serial_scan_stop(HANDLE hPortx,serial_packet_t *rsponse){
 	rsponse->size = 0;
 	serial_writeresp(hPortx,rsponse);
 	//Sleep(3);
-}
\ No newline at end of file
+}
+// 把多个通道的阈值写入拼成一次WriteFile发送，板子对每个通道各回一个ACK
+BOOL serial_write_thresholds(HANDLE hPortx, const uint16_t *threshold, uint64_t mask){
+	uint8_t buf[34 * 7];
+	int length = 0;
+	for(uint8_t ch = 0; ch < 34; ch++){
+		if(!(mask & (1ULL << ch))){
+			continue;
+		}
+		uint8_t *frame = &buf[length];
+		frame[0] = 0xff;
+		frame[1] = SERIAL_CMD_WRITE_MONO_THRESHOLD;
+		frame[2] = 3;
+		frame[3] = ch;
+		frame[4] = threshold[ch] & 0xff;
+		frame[5] = threshold[ch] >> 8;
+		frame[6] = frame[0] + frame[1] + frame[2] + frame[3] + frame[4] + frame[5];
+		length += 7;
+	}
+	if(length == 0){
+		return TRUE;
+	}
+	return send_data(hPortx, length, buf);
+}
@@ -9,6 +9,7 @@
 #include <conio.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include "serialtune.h"
 
 #define BUFSIZE 128
 #define CMD_TIMEOUT 3000
@@ -72,7 +73,9 @@ extern serial_packet_t request2;
 extern serial_packet_t response2;
 extern bool Serial_Status;//串口状态（是否成功打开）
 
+extern const struct serial_tune serial_default_tune;
 BOOL open_port(HANDLE *hPortx,char* comPortx);
+BOOL open_port_tune(HANDLE *hPortx, char* comPortx, const struct serial_tune *tune);
 void close_port(HANDLE *hPortx);
 void package_init(serial_packet_t *rsponse);
 uint8_t serial_read_cmd(HANDLE hPortx,serial_packet_t *request);
@@ -81,6 +84,7 @@ void serial_heart_beat(HANDLE hPortx,serial_packet_t *rsponse);
 // void serial_change_touch_threshold(HANDLE hPortx,serial_packet_t *rsponse,uint8_t *touch_threshold);
 void serial_scan_start(HANDLE hPortx,serial_packet_t *rsponse);
 void serial_scan_stop(HANDLE hPortx,serial_packet_t *rsponse);
+BOOL serial_write_thresholds(HANDLE hPortx, const uint16_t *threshold, uint64_t mask);
 char* GetSerialPortByVidPid(const char* vid, const char* pid);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include <windows.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "telemetry.h"
+
+static struct mai2_io_telemetry telemetry_local;
+static struct mai2_io_telemetry *telemetry;
+static uint32_t telemetry_gap_us;
+
+struct mai2_io_telemetry *mai2_io_telemetry_attach(void)
+{
+    struct mai2_io_telemetry *view;
+    HANDLE map;
+
+    if (telemetry != NULL) {
+        return telemetry;
+    }
+
+    map = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+            sizeof(struct mai2_io_telemetry), TELEMETRY_SHM_NAME);
+    view = NULL;
+
+    if (map != NULL) {
+        view = (struct mai2_io_telemetry *) MapViewOfFile(map,
+                FILE_MAP_ALL_ACCESS, 0, 0, sizeof(struct mai2_io_telemetry));
+    }
+
+    if (view == NULL) {
+        if (map != NULL) {
+            CloseHandle(map);
+        }
+        view = &telemetry_local;
+    }
+
+    if (InterlockedCompareExchangePointer((PVOID volatile *) &telemetry,
+            view, NULL) != NULL && view != &telemetry_local) {
+        /* Lost the race against another reader thread of this DLL */
+        UnmapViewOfFile(view);
+        CloseHandle(map);
+    }
+
+    return telemetry;
+}
+
+void mai2_io_telemetry_frame(int dev)
+{
+    struct mai2_io_dev_stats *s = &mai2_io_telemetry_attach()->dev[dev];
+
+    InterlockedIncrement(&s->frames);
+    s->last_frame_tick = GetTickCount();
+}
+
+void mai2_io_telemetry_buttons(int player, int64_t frame_qpc)
+{
+    InterlockedExchange64(&mai2_io_telemetry_attach()->poll.frame_qpc[player], frame_qpc);
+}
+
+void mai2_io_telemetry_bad_frame(int dev)
+{
+    InterlockedIncrement(&mai2_io_telemetry_attach()->dev[dev].bad_frames);
+}
+
+void mai2_io_telemetry_connected(int dev, bool connected)
+{
+    struct mai2_io_dev_stats *s = &mai2_io_telemetry_attach()->dev[dev];
+
+    if (connected && s->connected == 0) {
+        InterlockedIncrement(&s->connects);
+    }
+
+    InterlockedExchange(&s->connected, connected ? 1 : 0);
+}
+
+void mai2_io_telemetry_chatter(int player, uint8_t mask)
+{
+    struct mai2_io_telemetry *t = mai2_io_telemetry_attach();
+
+    for (; mask != 0; mask &= mask - 1) {
+        InterlockedIncrement(&t->chatter[player][__builtin_ctz(mask)]);
+    }
+}
+
+void mai2_io_telemetry_set_gap(uint32_t gap_ms)
+{
+    telemetry_gap_us = gap_ms * 1000;
+}
+
+int64_t mai2_io_telemetry_api_enter(int api)
+{
+    return cadence_enter(&mai2_io_telemetry_attach()->api[api], telemetry_gap_us);
+}
+
+void mai2_io_telemetry_api_leave(int api, int64_t entered)
+{
+    cadence_leave(&telemetry->api[api], entered);
+}
+
+/* First order tracking of the poll clock, in QPC ticks. Intervals more than
+   twice the period (a hitch, or a menu that stops polling) don't move the
+   estimate, they only resync the phase. Only the game's poll thread calls
+   this. */
+
+#define POLL_PHASE_SHIFT 4
+
+void mai2_io_telemetry_poll_phase(int64_t now)
+{
+    static int64_t last;
+    static int64_t period;
+    static int64_t jitter;
+    struct mai2_io_poll_phase *p = &telemetry->poll;
+    int64_t interval;
+    int64_t error;
+    int64_t frame;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        frame = p->frame_qpc[i];
+        if (frame != 0 && frame <= now) {
+            cadence_add(p->age[i], &p->age_max_us[i], cadence_us(now - frame));
+        }
+    }
+
+    interval = last != 0 ? now - last : 0;
+    last = now;
+
+    if (interval == 0) {
+        return;
+    }
+
+    if (period == 0) {
+        period = interval;
+    } else if (interval < 2 * period) {
+        error = now - p->next_poll_qpc;
+        if (error < 0) {
+            error = -error;
+        }
+        period += (interval - period) / (1 << POLL_PHASE_SHIFT);
+        jitter += (error - jitter) / (1 << POLL_PHASE_SHIFT);
+    }
+
+    p->period_us = (LONG) cadence_us(period);
+    p->jitter_us = (LONG) cadence_us(jitter);
+    p->locked = jitter * 10 < period;
+    p->next_poll_qpc = now + period;
+}
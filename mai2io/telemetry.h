@@ -0,0 +1,105 @@
+#pragma once
+
+#include <windows.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cadence.h"
+
+/* Per-device counters shared between every copy of the DLL that segatools
+   loads (and any external tool that wants to watch them), in the same way
+   the button state is shared through mai_io_shm_1/2. */
+
+#define TELEMETRY_SHM_NAME TEXT("mai_io_telemetry")
+
+enum {
+    MAI2_IO_DEV_1P = 0,
+    MAI2_IO_DEV_2P = 1,
+    MAI2_IO_DEV_KOBATO = 2,
+    MAI2_IO_DEV_COUNT = 3,
+};
+
+struct mai2_io_dev_stats {
+    volatile LONG connected;
+    volatile LONG frames;
+    volatile LONG bad_frames;
+    volatile LONG connects;
+    volatile DWORD last_frame_tick;
+};
+
+/* Game-facing entry points with call cadence stats (see cadence.h). The
+   touch callbacks are timed around the call into the game. */
+
+enum {
+    MAI2_IO_API_POLL = 0,
+    MAI2_IO_API_GET_OPBTNS = 1,
+    MAI2_IO_API_GET_GAMEBTNS = 2,
+    MAI2_IO_API_TOUCH_SET_SENS = 3,
+    MAI2_IO_API_TOUCH_CALLBACK_1P = 4,
+    MAI2_IO_API_TOUCH_CALLBACK_2P = 5,
+    MAI2_IO_API_LED_FET = 6,
+    MAI2_IO_API_LED_DC = 7,
+    MAI2_IO_API_LED_GS = 8,
+    MAI2_IO_API_COUNT = 9,
+};
+
+/* The game's poll clock, learned from mai2_io_poll timestamps, and the age
+   of each player's input at the moment it was polled (time since the touch
+   thread received the frame the buttons came from), as a log2 histogram in
+   microseconds like cadence.h.
+
+   The boards scan on their own clock and have no trigger or scan-rate
+   command, so the age can only be measured, not steered. period_us and
+   next_poll_qpc are what a board that could be triggered would be
+   scheduled from. */
+
+struct mai2_io_poll_phase {
+    volatile LONG period_us;    /* Smoothed poll period */
+    volatile LONG jitter_us;    /* Smoothed error of the predicted poll time */
+    volatile LONG locked;       /* jitter below a tenth of the period */
+    volatile LONG64 next_poll_qpc;
+    volatile LONG age[2][CADENCE_BUCKETS];
+    volatile LONG age_max_us[2];
+    /* Receive time of the frame behind mai_io_shm_1/2, 0 if none. Written
+       by whichever copy of the code writes the buttons, which is not the
+       one segatools polls. */
+    volatile LONG64 frame_qpc[2];
+};
+
+struct mai2_io_telemetry {
+    struct mai2_io_dev_stats dev[MAI2_IO_DEV_COUNT];
+    struct cadence_stats api[MAI2_IO_API_COUNT];
+    struct mai2_io_poll_phase poll;
+    /* Raw button transitions masked by the debounce (see debounce.h), per
+       player and button. A button that keeps counting has a worn switch. */
+    volatile LONG chatter[2][8];
+};
+
+/* Map the shared telemetry block, creating it if needed. Never returns NULL:
+   if the mapping can't be created a process-local block is used instead. */
+
+struct mai2_io_telemetry *mai2_io_telemetry_attach(void);
+
+void mai2_io_telemetry_frame(int dev);
+void mai2_io_telemetry_bad_frame(int dev);
+void mai2_io_telemetry_connected(int dev, bool connected);
+
+void mai2_io_telemetry_chatter(int player, uint8_t mask);
+
+/* Wrap a game-facing call: enter returns the value to pass to leave. Gaps
+   between calls longer than the threshold set with
+   mai2_io_telemetry_set_gap are counted as anomalies. */
+
+int64_t mai2_io_telemetry_api_enter(int api);
+void mai2_io_telemetry_api_leave(int api, int64_t entered);
+void mai2_io_telemetry_set_gap(uint32_t gap_ms);
+
+/* Called next to each write of a player's buttons with the receive time of
+   the frame they came from, or 0 when the buttons are cleared. */
+
+void mai2_io_telemetry_buttons(int player, int64_t frame_qpc);
+
+/* Called from mai2_io_poll with its entry time */
+
+void mai2_io_telemetry_poll_phase(int64_t now);
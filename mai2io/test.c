@@ -17,6 +17,7 @@
 #include "serial.h"
 #include "dprintf.h"
 #include "dfu_loader.h"
+#include "calib.h"
 
 /* ---------- 调试设置 ---------- */
 // #define DEBUG
@@ -228,7 +229,22 @@ DWORD autoRemapLastTime = 0;             // 上次收集时间
 uint8_t autoRemapRegions[TOUCH_REGIONS]; // 记录按触发顺序收集的区块
 char autoRemapStatus[32] = {0};          // 状态消息
 bool autoRemapCompletedRegions[TOUCH_REGIONS] = {false}; // 标记已完成的区块
-uint8_t prevTouchMatrix[8][8] = {0};     // 上一帧的触摸状态矩阵
+
+// 触摸边沿日志：读取线程每解析一帧就记录新按下的区块，自动映射按顺序消费，
+// 不会因为界面刷新慢而漏掉快速滑过的区块
+#define TOUCH_EDGE_JOURNAL_SIZE 256
+typedef struct
+{
+    DWORD time;     // 该帧被解析时的时间
+    uint8_t player; // 0 = 1P, 1 = 2P
+    uint8_t region; // 区块索引 (A1=0 ... E8=33)
+} TouchEdgeEvent;
+
+TouchEdgeEvent touchEdgeJournal[TOUCH_EDGE_JOURNAL_SIZE];
+unsigned int touchEdgeHead = 0;          // 写入位置
+unsigned int touchEdgeTail = 0;          // 读取位置
+unsigned int touchEdgeDropped = 0;       // 日志满时丢弃的事件数
+uint64_t lastTouchBits[2] = {0};         // 每个玩家上一帧的34位触摸状态
 
 /* ---------- 函数声明 ---------- */
 // 阈值读取辅助函数
@@ -266,6 +282,7 @@ void CheckAndStartThresholdReading(); // 检查并开始阈值读取
 
 // 阈值和触摸配置相关函数
 void ModifyThreshold();
+void AutoCalibrateThresholds();
 void InitThresholds();
 bool SendThreshold(HANDLE hPort, serial_packet_t *response, int index);
 void ReadAllThresholds(HANDLE hPort, serial_packet_t *response);
@@ -287,6 +304,7 @@ void StopAutoRemap(bool success); // 停止自动映射
 void UpdateAutoRemap();           // 更新自动映射状态
 void ProcessAutoRemapTouch();     // 处理自动映射时的触摸
 void CompleteAutoRemap();         // 完成自动映射并应用
+void RecordTouchEdges(int player, const uint8_t state[7]); // 记录新按下的区块
 
 // Kobato设备函数
 void ConnectKobato();
@@ -774,7 +792,7 @@ void DisplayMainWindow()
         printf("STOP   ");
     }
     SetConsoleTextAttribute(hConsole, defaultAttrs);
-    printf(" │    │  [F5] Modify Region Threshold  │   │ Select #1      ");
+    printf(" │    │  [F5] Threshold  [F8] Auto Cal │   │ Select #1      ");
 
     // 显示Select 按钮状态
     if (opButtons & (1 << 4))
@@ -1849,6 +1867,7 @@ void UpdateTouchData()
             {
             case SERIAL_CMD_AUTO_SCAN:
                 memcpy(p1TouchState, response1.touch, 7);
+                RecordTouchEdges(0, p1TouchState);
                 // memcpy(p1RawValue, response1.raw_value, 34);
                 player1Buttons = (response1.key_status[0] & 0x0F) | (response1.key_status[1] & 0xF0);
                 opButtons = response1.io_status;
@@ -1883,6 +1902,7 @@ void UpdateTouchData()
         {
         case SERIAL_CMD_AUTO_SCAN:
             memcpy(p2TouchState, response2.touch, 7);
+            RecordTouchEdges(1, p2TouchState);
             // memcpy(p2RawValue, response2.raw_value, 34);
             player2Buttons = (response2.key_status[0] & 0x0F) | (response2.key_status[1] & 0xF0);
             opButtons |= response2.io_status;
@@ -2251,6 +2271,13 @@ void HandleKeyInput()
                 ClearLine(23);
             }
             break;
+        case 66: // F8 - 自动校准阈值
+            if (currentWindow == WINDOW_MAIN)
+            {
+                AutoCalibrateThresholds();
+                dataChanged = true;
+            }
+            break;
         }
         break;
     }
@@ -2561,6 +2588,264 @@ void ModifyThreshold()
     ResumeHeartbeat();
 }
 
+// 读取一帧原始值（AUTO_SCAN帧长度为34时携带raw_value），没有读到返回false
+static bool ReadRawFrame(HANDLE hPort, serial_packet_t *response, uint8_t *raw)
+{
+    const int READ_ITERATIONS = 100;
+    uint8_t cmd;
+
+    for (int iteration = 0; iteration < READ_ITERATIONS; iteration++)
+    {
+        package_init(response);
+        cmd = serial_read_cmd(hPort, response);
+        if (cmd == SERIAL_CMD_AUTO_SCAN && response->size == TOUCH_REGIONS)
+        {
+            memcpy(raw, response->raw_value, TOUCH_REGIONS);
+            return true;
+        }
+        if (cmd == 0xff || cmd == 0xfe)
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+// 批量写入后统计收到的ACK数量
+static int CollectThresholdAcks(HANDLE hPort, serial_packet_t *response, int expected)
+{
+    DWORD startTime = GetTickCount();
+    int acked = 0;
+    uint8_t cmd;
+
+    while (acked < expected && (GetTickCount() - startTime) < 1000) // 1000ms超时
+    {
+        package_init(response);
+        cmd = serial_read_cmd(hPort, response);
+        if (cmd == SERIAL_CMD_WRITE_MONO_THRESHOLD && response->size >= 1 && response->data[3] == 0x01)
+        {
+            acked++;
+        }
+        else if (cmd == 0xff)
+        {
+            break;
+        }
+    }
+    return acked;
+}
+
+static int CountBits(uint64_t mask)
+{
+    int count = 0;
+    while (mask)
+    {
+        mask &= mask - 1;
+        count++;
+    }
+    return count;
+}
+
+// 自动校准阈值：先在无触摸时采集噪声，再在擦拭所有区域时采集触摸值，
+// 两个玩家同时进行，最后一次性批量写入所有阈值
+void AutoCalibrateThresholds()
+{
+    const DWORD NOISE_TIME = 2000;    // 噪声采集时长(ms)
+    const DWORD TOUCH_TIMEOUT = 20000; // 触摸采集最长时长(ms)
+    const uint64_t ALL_REGIONS = (1ULL << TOUCH_REGIONS) - 1;
+
+    struct calib_state calib[2];
+    HANDLE ports[2] = {hPort1, hPort2};
+    serial_packet_t *responses[2] = {&response1, &response2};
+    bool active[2] = {deviceState1p == DEVICE_OK, deviceState2p == DEVICE_OK};
+    uint16_t thresholds[2][TOUCH_REGIONS];
+    uint64_t ready[2] = {0, 0};
+    int frames[2] = {0, 0};
+    int acked[2] = {0, 0};
+    uint8_t raw[TOUCH_REGIONS];
+    DWORD startTime;
+    DWORD lastHeartbeat = 0;
+    bool cancelled = false;
+    int promptY = 23;
+    int key;
+
+    if (!active[0] && !active[1])
+    {
+        return;
+    }
+
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    GetConsoleScreenBufferInfo(hConsole, &csbi);
+    WORD defaultAttrs = csbi.wAttributes;
+
+    for (int i = promptY; i < promptY + 4; i++)
+    {
+        ClearLine(i);
+    }
+
+    SetCursorPosition(0, promptY);
+    printf("┏━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┓\n");
+    SetCursorPosition(0, promptY + 1);
+    printf("┃               Auto Threshold Calibration - Keep your hands OFF the touch panel              ┃\n");
+    SetCursorPosition(0, promptY + 2);
+    printf("┗━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┛\n");
+
+    calib_reset(&calib[0]);
+    calib_reset(&calib[1]);
+
+    // 第一阶段：采集噪声
+    // 校准期间主循环不运行，心跳包需要在这里发送，否则板子会停止上报
+    startTime = GetTickCount();
+    while (!cancelled && (GetTickCount() - startTime) < NOISE_TIME)
+    {
+        if (GetTickCount() - lastHeartbeat >= 100)
+        {
+            lastHeartbeat = GetTickCount();
+            for (int p = 0; p < 2; p++)
+            {
+                if (active[p])
+                {
+                    serial_heart_beat(ports[p], responses[p]);
+                }
+            }
+        }
+
+        for (int p = 0; p < 2; p++)
+        {
+            if (active[p] && ReadRawFrame(ports[p], responses[p], raw))
+            {
+                calib_add_noise(&calib[p], raw);
+                frames[p]++;
+            }
+        }
+
+        if (_kbhit() && _getch() == 27) // ESC
+        {
+            cancelled = true;
+        }
+    }
+
+    // 没有上报原始值的设备不参与校准
+    for (int p = 0; p < 2; p++)
+    {
+        active[p] = active[p] && frames[p] > 0;
+    }
+
+    if (!cancelled && !active[0] && !active[1])
+    {
+        SetCursorPosition(0, promptY + 3);
+        SetConsoleTextAttribute(hConsole, COLOR_RED);
+        printf("No raw values received! The firmware does not stream raw sensor data.");
+        SetConsoleTextAttribute(hConsole, defaultAttrs);
+        Sleep(2000);
+        cancelled = true;
+    }
+
+    // 第二阶段：采集触摸值，直到所有区域都采到足够样本
+    if (!cancelled)
+    {
+        SetCursorPosition(0, promptY + 1);
+        printf("┃      Rub every region of the touch panel now  (Enter: finish early, ESC: cancel)           ┃\n");
+    }
+
+    startTime = GetTickCount();
+    while (!cancelled && (GetTickCount() - startTime) < TOUCH_TIMEOUT)
+    {
+        if (GetTickCount() - lastHeartbeat >= 100)
+        {
+            lastHeartbeat = GetTickCount();
+            for (int p = 0; p < 2; p++)
+            {
+                if (active[p])
+                {
+                    serial_heart_beat(ports[p], responses[p]);
+                }
+            }
+
+            SetCursorPosition(0, promptY + 3);
+            printf("Regions calibrated  1P: %2d/34  2P: %2d/34   ",
+                   CountBits(ready[0]), CountBits(ready[1]));
+        }
+
+        for (int p = 0; p < 2; p++)
+        {
+            if (active[p] && ReadRawFrame(ports[p], responses[p], raw))
+            {
+                calib_add_touch(&calib[p], raw);
+                ready[p] = calib_ready_mask(&calib[p]);
+            }
+        }
+
+        if ((!active[0] || ready[0] == ALL_REGIONS) && (!active[1] || ready[1] == ALL_REGIONS))
+        {
+            break;
+        }
+
+        if (_kbhit())
+        {
+            key = _getch();
+            if (key == 27) // ESC
+            {
+                cancelled = true;
+            }
+            else if (key == 13) // Enter
+            {
+                break;
+            }
+        }
+    }
+
+    if (!cancelled)
+    {
+        // 先向两个设备都发出批量写入，再分别收ACK，两块板子的处理可以重叠
+        for (int p = 0; p < 2; p++)
+        {
+            memcpy(thresholds[p], touchThreshold, sizeof(thresholds[p]));
+            ready[p] = active[p] ? calib_propose(&calib[p], thresholds[p]) : 0;
+            if (ready[p] && !serial_write_thresholds(ports[p], thresholds[p], ready[p]))
+            {
+                ready[p] = 0;
+            }
+        }
+
+        for (int p = 0; p < 2; p++)
+        {
+            if (ready[p])
+            {
+                acked[p] = CollectThresholdAcks(ports[p], responses[p], CountBits(ready[p]));
+            }
+        }
+
+        // 界面显示当前选择的玩家的阈值
+        int shown = (usePlayer2 && ready[1]) || !ready[0] ? 1 : 0;
+        for (int i = 0; i < TOUCH_REGIONS; i++)
+        {
+            if (ready[shown] & (1ULL << i))
+            {
+                touchThreshold[i] = thresholds[shown][i];
+                thresholdReadFailed[i] = false;
+            }
+        }
+
+        ClearLine(promptY + 3);
+        SetCursorPosition(0, promptY + 3);
+        bool success = acked[0] == CountBits(ready[0]) && acked[1] == CountBits(ready[1]) &&
+                       (ready[0] || ready[1]);
+        SetConsoleTextAttribute(hConsole, success ? COLOR_GREEN : COLOR_RED);
+        printf("Calibration written  1P: %d/%d acked  2P: %d/%d acked",
+               acked[0], CountBits(ready[0]), acked[1], CountBits(ready[1]));
+        SetConsoleTextAttribute(hConsole, defaultAttrs);
+        Sleep(success ? 1500 : 2000);
+    }
+
+    for (int i = promptY; i < promptY + 4; i++)
+    {
+        ClearLine(i);
+    }
+
+    // 强制更新显示
+    dataChanged = true;
+}
+
 uint16_t ReadThreshold(HANDLE hPort, serial_packet_t *response, int index)
 {
     if (index < 0 || index >= TOUCH_REGIONS || hPort == INVALID_HANDLE_VALUE)
@@ -4195,7 +4480,7 @@ void StartAutoRemap()
     autoRemapLastTime = GetTickCount();
     memset(autoRemapRegions, 0xFF, TOUCH_REGIONS); // 初始化为无效值
     memset(autoRemapCompletedRegions, false, TOUCH_REGIONS); // 清空已完成标记
-    memset(prevTouchMatrix, 0, sizeof(prevTouchMatrix)); // 清空上一帧触摸状态
+    touchEdgeTail = touchEdgeHead; // 丢弃开始前的边沿事件
     
     // 设置收集状态
     strcpy(autoRemapStatus, "COLLECTING");
@@ -4243,78 +4528,87 @@ void UpdateAutoRemap()
     }
 }
 
-void ProcessAutoRemapTouch() 
+void RecordTouchEdges(int player, const uint8_t state[7])
 {
-    if (!autoRemapActive) {
-        return;
+    uint64_t bits = 0;
+    for (int i = 0; i < 7; i++)
+    {
+        bits |= (uint64_t)(state[i] & 0x1F) << (i * 5);
     }
 
-    // 处理当前触摸状态
-    bool currentTouchMatrix[8][8] = {false};
-    ProcessTouchStateBytes(usePlayer2 ? p2TouchState : p1TouchState, currentTouchMatrix);
+    uint64_t pressed = bits & ~lastTouchBits[player];
+    lastTouchBits[player] = bits;
 
-    // 区块索引映射
-    const struct {
-        int matrixX;
-        int matrixY;
-        int index;
-    } regionMapping[] = {
-        // D1-D8
-        {0, 0, 18}, {0, 1, 19}, {0, 2, 20}, {0, 3, 21}, {0, 4, 22}, {0, 5, 23}, {0, 6, 24}, {0, 7, 25},
-        // A1-A8
-        {1, 0, 0}, {1, 1, 1}, {1, 2, 2}, {1, 3, 3}, {1, 4, 4}, {1, 5, 5}, {1, 6, 6}, {1, 7, 7},
-        // E1-E8
-        {2, 0, 26}, {2, 1, 27}, {2, 2, 28}, {2, 3, 29}, {2, 4, 30}, {2, 5, 31}, {2, 6, 32}, {2, 7, 33},
-        // B1-B8
-        {3, 0, 8}, {3, 1, 9}, {3, 2, 10}, {3, 3, 11}, {3, 4, 12}, {3, 5, 13}, {3, 6, 14}, {3, 7, 15},
-        // C1-C2
-        {4, 0, 16}, {4, 1, 17}
-    };
+    if (!autoRemapActive || pressed == 0)
+    {
+        return;
+    }
 
-    // 找到新触发的区块（当前触发但上一帧未触发的区块）
-    for (int i = 0; i < sizeof(regionMapping) / sizeof(regionMapping[0]); i++) {
-        int x = regionMapping[i].matrixX;
-        int y = regionMapping[i].matrixY;
-        int regionIndex = regionMapping[i].index;
+    DWORD now = GetTickCount();
 
-        // 检查是否是新触发的区块（当前触发且上一帧未触发）
-        bool isNewTouch = currentTouchMatrix[y][x] && !prevTouchMatrix[y][x];
-        
-        if (isNewTouch) {
-            // 检查此区块是否已被记录
-            bool alreadyRecorded = false;
-            for (int j = 0; j < autoRemapCollected; j++) {
-                if (autoRemapRegions[j] == regionIndex) {
-                    alreadyRecorded = true;
-                    break;
-                }
-            }
+    // 同一帧内按区块索引顺序记录
+    for (int region = 0; region < TOUCH_REGIONS; region++)
+    {
+        if (!(pressed & (1ULL << region)))
+        {
+            continue;
+        }
 
-            // 如果是新区块，记录它
-            if (!alreadyRecorded) {
-                // 记录区块到下一个可用位置
-                autoRemapRegions[autoRemapCollected] = regionIndex;
-                autoRemapCompletedRegions[regionIndex] = true; // 标记为已完成
-                autoRemapCollected++;
-                autoRemapLastTime = GetTickCount();
-                dataChanged = true;
-                
-                // 实时更新进度状态
-                if (autoRemapCollected >= 34) {
-                    // 所有区块都已收集完成
-                    autoRemapCompletedStages = 4;
-                    strcpy(autoRemapStatus, "ALL REGIONS COLLECTED");
-                    StopAutoRemap(true);
-                } else {
-                    // 更新收集进度状态
-                    snprintf(autoRemapStatus, sizeof(autoRemapStatus), "COLLECTED: %d/34", autoRemapCollected);
-                }
-            }
+        if (touchEdgeHead - touchEdgeTail >= TOUCH_EDGE_JOURNAL_SIZE)
+        {
+            touchEdgeTail++; // 日志已满，丢弃最旧的事件
+            touchEdgeDropped++;
         }
+
+        TouchEdgeEvent *ev = &touchEdgeJournal[touchEdgeHead % TOUCH_EDGE_JOURNAL_SIZE];
+        ev->time = now;
+        ev->player = (uint8_t)player;
+        ev->region = (uint8_t)region;
+        touchEdgeHead++;
     }
+}
 
-    // 更新上一帧的触摸状态
-    memcpy(prevTouchMatrix, currentTouchMatrix, sizeof(prevTouchMatrix));
+void ProcessAutoRemapTouch() 
+{
+    int player = usePlayer2 ? 1 : 0;
+
+    // 按发生顺序消费边沿日志中的所有按下事件
+    while (autoRemapActive && touchEdgeTail != touchEdgeHead)
+    {
+        TouchEdgeEvent ev = touchEdgeJournal[touchEdgeTail % TOUCH_EDGE_JOURNAL_SIZE];
+        touchEdgeTail++;
+
+        if (ev.player != player)
+        {
+            continue;
+        }
+
+        int regionIndex = ev.region;
+
+        // 检查此区块是否已被记录
+        if (autoRemapCompletedRegions[regionIndex])
+        {
+            continue;
+        }
+
+        // 记录区块到下一个可用位置
+        autoRemapRegions[autoRemapCollected] = regionIndex;
+        autoRemapCompletedRegions[regionIndex] = true; // 标记为已完成
+        autoRemapCollected++;
+        autoRemapLastTime = ev.time;
+        dataChanged = true;
+
+        // 实时更新进度状态
+        if (autoRemapCollected >= TOUCH_REGIONS) {
+            // 所有区块都已收集完成
+            autoRemapCompletedStages = 4;
+            strcpy(autoRemapStatus, "ALL REGIONS COLLECTED");
+            StopAutoRemap(true);
+        } else {
+            // 更新收集进度状态
+            snprintf(autoRemapStatus, sizeof(autoRemapStatus), "COLLECTED: %d/34", autoRemapCollected);
+        }
+    }
 }
 
 void CompleteAutoRemap()
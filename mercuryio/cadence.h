@@ -0,0 +1,92 @@
+#pragma once
+
+#include <windows.h>
+
+#include <limits.h>
+#include <stdint.h>
+
+/* Call cadence profiling for the game-facing entry points.
+
+   Each profiled API keeps two log2 histograms in microseconds: the interval
+   between consecutive calls (how regularly the game calls us) and the time
+   spent inside the call (how long we, or the game's callback, held the
+   thread). Bucket 0 counts values under 1 us, bucket b counts values in
+   [2^(b-1), 2^b) us and the last bucket everything longer. Intervals above
+   the gap threshold are also counted separately.
+
+   The cost per call is two QueryPerformanceCounter reads and a handful of
+   interlocked increments. The same header is used by every IO DLL. */
+
+#define CADENCE_BUCKETS 20
+
+struct cadence_stats {
+    volatile LONG calls;
+    volatile LONG gaps;
+    volatile LONG max_interval_us;
+    volatile LONG max_duration_us;
+    volatile LONG interval[CADENCE_BUCKETS];
+    volatile LONG duration[CADENCE_BUCKETS];
+    volatile LONG64 last_enter;
+};
+
+static inline int64_t cadence_us(int64_t ticks)
+{
+    static volatile LONG64 freq;
+    LARGE_INTEGER f;
+
+    if (freq == 0) {
+        QueryPerformanceFrequency(&f);
+        freq = f.QuadPart;
+    }
+
+    return ticks * 1000000 / freq;
+}
+
+static inline void cadence_add(volatile LONG *hist, volatile LONG *max, int64_t us)
+{
+    int bucket = 0;
+
+    if (us > 0) {
+        bucket = 64 - __builtin_clzll((uint64_t) us);
+        if (bucket >= CADENCE_BUCKETS) {
+            bucket = CADENCE_BUCKETS - 1;
+        }
+    }
+
+    InterlockedIncrement(&hist[bucket]);
+
+    if (us > *max) {
+        *max = us > LONG_MAX ? LONG_MAX : (LONG) us;
+    }
+}
+
+/* Returns the entry time to pass to cadence_leave */
+
+static inline int64_t cadence_enter(struct cadence_stats *s, uint32_t gap_us)
+{
+    LARGE_INTEGER now;
+    int64_t last;
+    int64_t us;
+
+    QueryPerformanceCounter(&now);
+    last = InterlockedExchange64(&s->last_enter, now.QuadPart);
+    InterlockedIncrement(&s->calls);
+
+    if (last != 0) {
+        us = cadence_us(now.QuadPart - last);
+        cadence_add(s->interval, &s->max_interval_us, us);
+        if (gap_us != 0 && us > gap_us) {
+            InterlockedIncrement(&s->gaps);
+        }
+    }
+
+    return now.QuadPart;
+}
+
+static inline void cadence_leave(struct cadence_stats *s, int64_t entered)
+{
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    cadence_add(s->duration, &s->max_duration_us, cadence_us(now.QuadPart - entered));
+}
@@ -33,6 +33,28 @@ void mercury_io_config_load(
     cfg->vk_vol_up = GetPrivateProfileIntW(L"io4", L"volup", VK_UP, filename);
     cfg->vk_vol_down = GetPrivateProfileIntW(L"io4", L"voldown", VK_DOWN, filename);
 
+    /* Turn off when the board reports the operator buttons itself */
+    cfg->keyboard = GetPrivateProfileIntW(L"io4", L"keyboard", 1, filename);
+
+    /* Gaps between game calls longer than this many ms are counted, 0 disables */
+    cfg->cadence_gap = GetPrivateProfileIntW(L"cadence", L"gapThreshold", 50, filename);
+
+    /* Two boards, the first covering cells 1-120 and the second 121-240.
+       port1/port2 are COM port numbers, 0 finds the boards by VID/PID in
+       enumeration order; a board that reconnects goes back to its own port
+       or takes one the other board isn't using. A half older than staleLimit ms when the other
+       half arrives is released rather than merged. */
+    cfg->dual_board = GetPrivateProfileIntW(L"touch", L"dualBoard", 0, filename);
+    cfg->port[0] = GetPrivateProfileIntW(L"touch", L"port1", 0, filename);
+    cfg->port[1] = GetPrivateProfileIntW(L"touch", L"port2", 0, filename);
+    cfg->stale_ms = GetPrivateProfileIntW(L"touch", L"staleLimit", 20, filename);
+
+    /* Hold back single cells that light up alone for one frame (ringfilter.h) */
+    cfg->noise_filter = GetPrivateProfileIntW(L"touch", L"noiseFilter", 0, filename);
+
+    /* Call the game at most this many times a second, folding the frames in between (holddec.h). 0 disables */
+    cfg->max_rate = GetPrivateProfileIntW(L"touch", L"maxRate", 0, filename);
+
     for (i = 0 ; i < 240 ; i++) {
         swprintf_s(key, _countof(key), L"cell%i", i + 1);
         cfg->vk_cell[i] = GetPrivateProfileIntW(
@@ -11,7 +11,14 @@ struct mercury_io_config {
     uint8_t vk_coin;
     uint8_t vk_vol_up;
     uint8_t vk_vol_down;
+    bool keyboard;
     uint8_t vk_cell[240];
+    uint32_t cadence_gap;
+    bool dual_board;
+    uint8_t port[2];
+    uint32_t stale_ms;
+    bool noise_filter;
+    uint32_t max_rate;
 };
 
 void mercury_io_config_load(
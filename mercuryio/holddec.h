@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Output rate limiting for touch streams.
+
+   When the board scans faster than the game should be called, the frames
+   between two deliveries are folded together instead of dropped. Touch
+   bits are packed into 64-bit words:
+
+   - A bit that was off at the last delivery is delivered on if it was on
+     in any frame since, so a touch shorter than the interval still reaches
+     the game.
+   - A bit that was on is delivered off if it was released in any frame
+     since, so the release edge is kept even if it was pressed again. Such
+     a press is delivered on the following delivery.
+
+   The game is called at most once per interval. Analog values (chuni
+   pressure) are max-held by the caller next to this. The same header is
+   used by every IO DLL. */
+
+#define HOLD_WORDS 4
+
+struct hold_decimator {
+    int64_t interval;               /* QPC ticks, 0 delivers every frame */
+    int64_t last;                   /* Time of the last delivery */
+    uint32_t folded;                /* Frames that weren't delivered on their own */
+    uint64_t out[HOLD_WORDS];       /* Last delivered state */
+    uint64_t cur[HOLD_WORDS];       /* Latest frame */
+    uint64_t raw[HOLD_WORDS];       /* Latest frame as received, for hold_flush */
+    uint64_t seen[HOLD_WORDS];      /* On in any frame since the last delivery */
+    uint64_t rel[HOLD_WORDS];       /* Released since the last delivery */
+    uint64_t again[HOLD_WORDS];     /* Pressed again after such a release */
+};
+
+static inline void hold_init(struct hold_decimator *h, int64_t interval)
+{
+    memset(h, 0, sizeof(*h));
+    h->interval = interval;
+}
+
+/* The caller delivered frame itself (disconnects): restart folding from it.
+   Anything folded since the last delivery is dropped. */
+
+static inline void hold_force(struct hold_decimator *h, const uint64_t *frame, int words, int64_t now)
+{
+    int i;
+
+    for (i = 0; i < words; i++) {
+        h->out[i] = frame[i];
+        h->cur[i] = frame[i];
+        h->raw[i] = frame[i];
+        h->seen[i] = 0;
+        h->rel[i] = 0;
+        h->again[i] = 0;
+    }
+
+    h->last = now;
+}
+
+static inline void hold_fold(struct hold_decimator *h, const uint64_t *frame, int words)
+{
+    int i;
+
+    for (i = 0; i < words; i++) {
+        h->rel[i] |= h->cur[i] & ~frame[i];
+        h->again[i] |= h->rel[i] & frame[i];
+        h->seen[i] |= frame[i];
+        h->cur[i] = frame[i];
+        h->raw[i] = frame[i];
+    }
+}
+
+static inline void hold_deliver(struct hold_decimator *h, int words, int64_t now, uint64_t *out)
+{
+    uint64_t o;
+    int i;
+
+    h->last = now;
+
+    for (i = 0; i < words; i++) {
+        o = (~h->out[i] & h->seen[i]) | (h->out[i] & ~h->rel[i]);
+        out[i] = o;
+        h->out[i] = o;
+        h->cur[i] = o;
+        h->seen[i] = h->rel[i] & h->again[i] & ~o;
+        h->rel[i] = 0;
+        h->again[i] = 0;
+    }
+}
+
+/* Fold one frame. Returns true, with the state to deliver in out, once the
+   interval since the last delivery has passed. */
+
+static inline bool hold_add(struct hold_decimator *h, const uint64_t *frame, int words, int64_t now, uint64_t *out)
+{
+    hold_fold(h, frame, words);
+
+    if (h->interval > 0 && h->last != 0 && now - h->last < h->interval) {
+        h->folded++;
+        return false;
+    }
+
+    hold_deliver(h, words, now, out);
+
+    return true;
+}
+
+/* For read timeouts: when no frame arrives, fold the latest one again and
+   return true, with the state to deliver in out, if the interval has passed
+   and that state differs from the last delivery. A tap folded into one
+   delivery is released on the next one even while the stream is paused. */
+
+static inline bool hold_flush(struct hold_decimator *h, int words, int64_t now, uint64_t *out)
+{
+    uint64_t raw[HOLD_WORDS];
+    bool pending = false;
+    int i;
+
+    if (h->interval > 0 && h->last != 0 && now - h->last < h->interval) {
+        return false;
+    }
+
+    memcpy(raw, h->raw, sizeof(raw));
+    hold_fold(h, raw, words);
+
+    for (i = 0; i < words; i++) {
+        if (((~h->out[i] & h->seen[i]) | (h->out[i] & ~h->rel[i])) != h->out[i]) {
+            pending = true;
+        }
+    }
+
+    if (!pending) {
+        return false;
+    }
+
+    hold_deliver(h, words, now, out);
+
+    return true;
+}
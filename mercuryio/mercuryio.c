@@ -6,9 +6,10 @@
 
 #include "mercuryio.h"
 #include "config.h"
+#include "holddec.h"
 
+#include "ringfilter.h"
 #include "serialslider.h"
-extern char comPort[13];
 char* vid = "VID_AFF1";
 char* pid = "PID_52A5";
 
@@ -18,7 +19,57 @@ static uint8_t mercury_opbtn;
 static uint8_t mercury_gamebtn;
 static struct mercury_io_config mercury_io_cfg;
 static bool mercury_io_touch_stop_flag;
-static HANDLE mercury_io_touch_thread;
+static mercury_io_touch_callback_t mercury_io_touch_callback;
+
+/* One reader thread per board. With a single board it covers the whole
+   ring; with [touch] dualBoard=1 board 0 owns cells 0-119 (cells[0-14])
+   and board 1 cells 120-239 (cells[15-29]). Half-frames are merged under
+   mercury_io_merge_lock, which also keeps the two threads from calling into
+   the game at the same time. */
+struct mercury_io_board {
+    slider_port_t port;
+    char home[16]; /* first port found for this board, dual mode only */
+    int index;
+    uint8_t cells[30];
+    int64_t qpc;
+    HANDLE thread;
+};
+
+static struct mercury_io_board mercury_io_boards[2];
+static int mercury_io_board_count;
+static SRWLOCK mercury_io_merge_lock = SRWLOCK_INIT;
+static SRWLOCK mercury_io_find_lock = SRWLOCK_INIT;
+static struct mercury_io_ext_merge mercury_io_merge;
+static struct ring_filter mercury_io_ring_filter;
+static struct mercury_io_ext_noise mercury_io_noise;
+static struct hold_decimator mercury_io_touch_hold;
+
+/* How often a disconnected board's port is looked up again (SetupAPI) */
+#define MERCURY_IO_RECONNECT_INTERVAL 100
+
+/* Latest frame for mercury_io_ext_get_touch. Only the touch thread writes
+   it; lock is odd while it does. */
+static volatile LONG mercury_io_ext_lock;
+static struct mercury_io_ext_touch mercury_io_ext;
+
+static struct cadence_stats mercury_io_cadence[MERCURY_IO_API_COUNT];
+
+/* Operator buttons. Firmware that appends an io_status byte after the cells
+   reports them itself. The touch thread latches every bit it sees until the
+   next poll, so a press shorter than a poll isn't lost. Coin pulses are
+   counted instead, and each one is replayed to the game as a press on one
+   poll and a release on the next, so two pulses within a poll still add two
+   credits. The keyboard can be turned off with [io4] keyboard=0. */
+#define MERCURY_IO_IO_TEST 0x01
+#define MERCURY_IO_IO_SERVICE 0x02
+#define MERCURY_IO_IO_COIN 0x04
+#define MERCURY_IO_IO_VOL_UP 0x08
+#define MERCURY_IO_IO_VOL_DOWN 0x10
+
+static volatile LONG mercury_io_board_io;
+static volatile LONG mercury_io_board_latch;
+static volatile LONG mercury_io_board_coins;
+static bool mercury_io_board_coin_out;
 
 uint16_t mercury_io_get_api_version(void)
 {
@@ -27,160 +78,458 @@ uint16_t mercury_io_get_api_version(void)
 
 HRESULT mercury_io_init(void)
 {
+    LARGE_INTEGER freq;
+
     mercury_io_config_load(&mercury_io_cfg, L".\\segatools.ini");
 
+    QueryPerformanceFrequency(&freq);
+    hold_init(&mercury_io_touch_hold, mercury_io_cfg.max_rate ? freq.QuadPart / mercury_io_cfg.max_rate : 0);
+
     return S_OK;
 }
 
 HRESULT mercury_io_poll(void)
 {
+    int64_t entered = cadence_enter(&mercury_io_cadence[MERCURY_IO_API_POLL], mercury_io_cfg.cadence_gap * 1000);
+    uint8_t board;
+
     mercury_opbtn = 0;
     mercury_gamebtn = 0;
 
-    if (GetAsyncKeyState(mercury_io_cfg.vk_test)) {
+    board = (uint8_t) InterlockedExchange(&mercury_io_board_latch, mercury_io_board_io);
+
+    if (board & MERCURY_IO_IO_TEST) {
         mercury_opbtn |= MERCURY_IO_OPBTN_TEST;
     }
 
-    if (GetAsyncKeyState(mercury_io_cfg.vk_service)) {
+    if (board & MERCURY_IO_IO_SERVICE) {
         mercury_opbtn |= MERCURY_IO_OPBTN_SERVICE;
     }
 
-    if (GetAsyncKeyState(mercury_io_cfg.vk_coin)) {
+    if (mercury_io_board_coin_out) {
+        mercury_io_board_coin_out = false;
+    } else if (mercury_io_board_coins > 0) {
+        InterlockedDecrement(&mercury_io_board_coins);
+        mercury_io_board_coin_out = true;
         mercury_opbtn |= MERCURY_IO_OPBTN_COIN;
     }
 
-    if (GetAsyncKeyState(mercury_io_cfg.vk_vol_up)) {
+    if (board & MERCURY_IO_IO_VOL_UP) {
         mercury_gamebtn |= MERCURY_IO_GAMEBTN_VOL_UP;
     }
 
-    if (GetAsyncKeyState(mercury_io_cfg.vk_vol_down)) {
+    if (board & MERCURY_IO_IO_VOL_DOWN) {
         mercury_gamebtn |= MERCURY_IO_GAMEBTN_VOL_DOWN;
     }
 
+    if (mercury_io_cfg.keyboard) {
+        if (GetAsyncKeyState(mercury_io_cfg.vk_test)) {
+            mercury_opbtn |= MERCURY_IO_OPBTN_TEST;
+        }
+
+        if (GetAsyncKeyState(mercury_io_cfg.vk_service)) {
+            mercury_opbtn |= MERCURY_IO_OPBTN_SERVICE;
+        }
+
+        if (GetAsyncKeyState(mercury_io_cfg.vk_coin)) {
+            mercury_opbtn |= MERCURY_IO_OPBTN_COIN;
+        }
+
+        if (GetAsyncKeyState(mercury_io_cfg.vk_vol_up)) {
+            mercury_gamebtn |= MERCURY_IO_GAMEBTN_VOL_UP;
+        }
+
+        if (GetAsyncKeyState(mercury_io_cfg.vk_vol_down)) {
+            mercury_gamebtn |= MERCURY_IO_GAMEBTN_VOL_DOWN;
+        }
+    }
+
+    cadence_leave(&mercury_io_cadence[MERCURY_IO_API_POLL], entered);
     return S_OK;
 }
 
 void mercury_io_get_opbtns(uint8_t *opbtn)
 {
+    int64_t entered = cadence_enter(&mercury_io_cadence[MERCURY_IO_API_GET_OPBTNS], mercury_io_cfg.cadence_gap * 1000);
+
     if (opbtn != NULL) {
         *opbtn = mercury_opbtn;
     }
+    cadence_leave(&mercury_io_cadence[MERCURY_IO_API_GET_OPBTNS], entered);
 }
 
 void mercury_io_get_gamebtns(uint8_t *gamebtn)
 {
+    int64_t entered = cadence_enter(&mercury_io_cadence[MERCURY_IO_API_GET_GAMEBTNS], mercury_io_cfg.cadence_gap * 1000);
+
     if (gamebtn != NULL) {
         *gamebtn = mercury_gamebtn;
     }
+    cadence_leave(&mercury_io_cadence[MERCURY_IO_API_GET_GAMEBTNS], entered);
+}
+
+/* Dual mode without port1/port2. The enumeration order changes while a
+   board is unplugged, so the Nth device may now be the other board. Go
+   back to the port this board was first found on while it is still
+   listed, otherwise take the first listed port the other board isn't
+   using. Both reader threads can be looking at once, hence the lock. */
+
+#define MERCURY_IO_MAX_DEVICES 8
+
+static void mercury_io_board_pick(struct mercury_io_board *board)
+{
+    const struct mercury_io_board *other = &mercury_io_boards[!board->index];
+    slider_port_t found;
+    bool home = false;
+    int spare = -1;
+    int i;
+
+    AcquireSRWLockExclusive(&mercury_io_find_lock);
+
+    for (i = 0; i < MERCURY_IO_MAX_DEVICES && slider_port_find(&found, vid, pid, i); i++) {
+        if (board->home[0] != 0 && strcmp(found.name, board->home) == 0) {
+            home = true;
+            break;
+        }
+        if (spare < 0 && strcmp(found.name, other->port.name) != 0) {
+            spare = i;
+        }
+    }
+
+    if (home) {
+        strcpy(board->port.name, board->home);
+    } else if (spare >= 0 && slider_port_find(&found, vid, pid, spare)) {
+        strcpy(board->port.name, found.name);
+    }
+
+    if (board->home[0] == 0 && board->port.name[0] != 0) {
+        strcpy(board->home, board->port.name);
+    }
+
+    ReleaseSRWLockExclusive(&mercury_io_find_lock);
+}
+
+/* Pick the port of one board: [touch] portN if set, otherwise by VID/PID.
+   A single board falls back to COM20 as before. */
+
+static void mercury_io_board_find(struct mercury_io_board *board)
+{
+    if (mercury_io_cfg.port[board->index] != 0) {
+        snprintf(board->port.name, sizeof(board->port.name), "\\\\.\\COM%d", mercury_io_cfg.port[board->index]);
+    } else if (mercury_io_board_count == 2) {
+        mercury_io_board_pick(board);
+    } else if (!slider_port_find(&board->port, vid, pid, 0) && board->port.name[0] == 0) {
+        snprintf(board->port.name, sizeof(board->port.name), "\\\\.\\COM%d", 20);
+    }
 }
 
 HRESULT mercury_io_touch_init(void)
 {
+    struct serial_tune tune;
+    int i;
+
+    /* Built-in driver settings, overridden by [serial.VID_AFF1&PID_52A5] */
+    slider_get_tune(&tune);
+    serial_tune_load(&tune, vid, pid, L".\\segatools.ini");
+    slider_set_tune(&tune);
+    serial_tune_latency(vid, pid, tune.latency_timer);
+
+    mercury_io_board_count = mercury_io_cfg.dual_board ? 2 : 1;
+
     // Open ports
-    strncpy(comPort,GetSerialPortByVidPid(vid,pid),6);
-    if(comPort[0] == 0){
-        int port_num = 20;
-        snprintf(comPort, 10, "\\\\.\\COM%d", port_num);
-    }else if(comPort[4] == 0){
-    }else if(comPort[5] == 0){
-        int port_num = (comPort[3]-48)*10 + (comPort[4]-48);
-        snprintf(comPort, 10, "\\\\.\\COM%d", port_num);
-    }else{
-        int port_num = (comPort[3]-48)*100 + (comPort[4]-48)*10 + (comPort[5]-48);
-        snprintf(comPort, 11, "\\\\.\\COM%d", port_num);
-        
-    }
-    open_port();
+    for (i = 0; i < mercury_io_board_count; i++) {
+        slider_port_init(&mercury_io_boards[i].port);
+        mercury_io_boards[i].index = i;
+        mercury_io_board_find(&mercury_io_boards[i]);
+        slider_port_open(&mercury_io_boards[i].port);
+    }
+
     return S_OK;
 }
 
 void mercury_io_touch_start(mercury_io_touch_callback_t callback)
 {
-    if (mercury_io_touch_thread != NULL) {
+    int i;
+
+    if (mercury_io_touch_callback != NULL) {
         return;
     }
 
-    mercury_io_touch_thread = (HANDLE) _beginthreadex(
-        NULL,
-        0,
-        mercury_io_touch_thread_proc,
-        callback,
-        0,
-        NULL
-    );
+    mercury_io_touch_callback = callback;
+
+    for (i = 0; i < mercury_io_board_count; i++) {
+        mercury_io_boards[i].thread = (HANDLE) _beginthreadex(
+            NULL,
+            0,
+            mercury_io_touch_thread_proc,
+            &mercury_io_boards[i],
+            0,
+            NULL
+        );
+    }
 }
 
 void mercury_io_touch_set_leds(struct led_data data)
 {
+    int64_t entered = cadence_enter(&mercury_io_cadence[MERCURY_IO_API_TOUCH_SET_LEDS], mercury_io_cfg.cadence_gap * 1000);
+
     //slider_send_leds(rgb);
+    cadence_leave(&mercury_io_cadence[MERCURY_IO_API_TOUCH_SET_LEDS], entered);
 }
 
-static unsigned int __stdcall mercury_io_touch_thread_proc(void *ctx)
+static void mercury_io_board_status(uint8_t io)
+{
+    LONG last = InterlockedExchange(&mercury_io_board_io, io);
+
+    InterlockedOr(&mercury_io_board_latch, io);
+
+    if ((io & MERCURY_IO_IO_COIN) && !(last & MERCURY_IO_IO_COIN)) {
+        InterlockedIncrement(&mercury_io_board_coins);
+    }
+}
+
+static int64_t mercury_io_qpc(void)
+{
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+/* Hand a frame to the game and keep a copy for the extended exports */
+
+static void mercury_io_touch_deliver(mercury_io_touch_callback_t callback, const bool *state, const uint8_t *cells, int64_t device_qpc)
+{
+    int64_t host_qpc = cadence_enter(&mercury_io_cadence[MERCURY_IO_API_TOUCH_CALLBACK], mercury_io_cfg.cadence_gap * 1000);
+
+    callback(state);
+    cadence_leave(&mercury_io_cadence[MERCURY_IO_API_TOUCH_CALLBACK], host_qpc);
+
+    InterlockedIncrement(&mercury_io_ext_lock);
+    mercury_io_ext.seq++;
+    memcpy(mercury_io_ext.cells, cells, 30);
+    mercury_io_ext.device_qpc = device_qpc;
+    mercury_io_ext.host_qpc = host_qpc;
+    InterlockedIncrement(&mercury_io_ext_lock);
+}
+
+bool mercury_io_ext_get_touch(struct mercury_io_ext_touch *out)
+{
+    LONG lock;
+
+    if (out == NULL) {
+        return false;
+    }
+
+    do {
+        lock = mercury_io_ext_lock;
+        MemoryBarrier();
+        *out = mercury_io_ext;
+        MemoryBarrier();
+    } while ((lock & 1) || lock != mercury_io_ext_lock);
+
+    return out->seq != 0;
+}
+
+bool mercury_io_ext_get_merge(struct mercury_io_ext_merge *out)
+{
+    if (out == NULL) {
+        return false;
+    }
+
+    AcquireSRWLockShared(&mercury_io_merge_lock);
+    *out = mercury_io_merge;
+    ReleaseSRWLockShared(&mercury_io_merge_lock);
+
+    return true;
+}
+
+bool mercury_io_ext_get_noise(struct mercury_io_ext_noise *out)
+{
+    if (out == NULL) {
+        return false;
+    }
+
+    AcquireSRWLockShared(&mercury_io_merge_lock);
+    *out = mercury_io_noise;
+    ReleaseSRWLockShared(&mercury_io_merge_lock);
+
+    return true;
+}
+
+bool mercury_io_ext_get_cadence(uint8_t api, struct cadence_stats *out)
+{
+    if (out == NULL || api >= MERCURY_IO_API_COUNT) {
+        return false;
+    }
+
+    *out = mercury_io_cadence[api];
+    return true;
+}
+
+/* Called with mercury_io_merge_lock held */
+
+static void mercury_io_touch_filter(uint8_t *cells)
+{
+    uint64_t ring[RING_WORDS];
+    uint64_t suppressed[RING_WORDS];
+    uint64_t bits;
+    int i;
+
+    ring_from_cells(ring, cells);
+    ring_filter_apply(&mercury_io_ring_filter, ring, suppressed);
+    ring_to_cells(cells, ring);
+
+    InterlockedIncrement(&mercury_io_noise.frames);
+
+    for (i = 0; i < RING_WORDS; i++) {
+        for (bits = suppressed[i]; bits != 0; bits &= bits - 1) {
+            InterlockedIncrement(&mercury_io_noise.suppressed[ring_sector(i * 64 + __builtin_ctzll(bits))]);
+        }
+    }
+}
+
+/* Called with mercury_io_merge_lock held */
+
+static void mercury_io_touch_deliver_ring(const uint64_t *ring, int64_t decoded)
 {
-    mercury_io_touch_callback_t callback;
     bool cellPressed[240];
-    uint8_t cell_raw[30];
-    size_t i;
+    uint8_t merged[30];
+    int i;
+
+    ring_to_cells(merged, ring);
+
+    for (i = 0; i < 240; i++) {
+        cellPressed[i] = (merged[i / 8] >> (i % 8)) & 1;
+    }
 
-    callback = ctx;
+    mercury_io_touch_deliver(mercury_io_touch_callback, cellPressed, merged, decoded);
+}
+
+/* Store the cells of one board and hand the merged ring to the game,
+   subject to [touch] maxRate. idle is set for the release published once
+   when a board's link drops: it isn't a frame from the board, so it doesn't
+   refresh the board's timestamp, and a single board delivers it at once.
+   With two boards it is folded like a frame so that the other board's
+   pending touches are kept. */
+
+static void mercury_io_touch_publish(struct mercury_io_board *board, const uint8_t *cells, int64_t decoded, bool idle)
+{
+    struct mercury_io_board *other;
+    uint64_t ring[RING_WORDS];
+    uint8_t merged[30];
+    int64_t skew;
+
+    AcquireSRWLockExclusive(&mercury_io_merge_lock);
+
+    if (mercury_io_board_count == 1) {
+        memcpy(board->cells, cells, 30);
+        memcpy(merged, board->cells, 30);
+    } else {
+        memcpy(&board->cells[board->index * 15], &cells[board->index * 15], 15);
+        if (!idle) {
+            board->qpc = decoded;
+            InterlockedIncrement(&mercury_io_merge.frames[board->index]);
+        }
+
+        other = &mercury_io_boards[1 - board->index];
+        memcpy(&merged[board->index * 15], &board->cells[board->index * 15], 15);
+        memcpy(&merged[other->index * 15], &other->cells[other->index * 15], 15);
+
+        skew = other->qpc != 0 ? cadence_us(decoded - other->qpc) : -1;
+
+        if (skew < 0 || skew > (int64_t) mercury_io_cfg.stale_ms * 1000) {
+            memset(&merged[other->index * 15], 0, 15);
+            if (!idle) {
+                InterlockedIncrement(&mercury_io_merge.stale);
+            }
+        } else if (!idle) {
+            cadence_add(mercury_io_merge.skew, &mercury_io_merge.max_skew_us, skew);
+        }
+    }
+
+    if (mercury_io_cfg.noise_filter) {
+        mercury_io_touch_filter(merged);
+    }
+
+    ring_from_cells(ring, merged);
+
+    if (idle && mercury_io_board_count == 1) {
+        hold_force(&mercury_io_touch_hold, ring, RING_WORDS, decoded);
+        mercury_io_touch_deliver_ring(ring, decoded);
+    } else if (hold_add(&mercury_io_touch_hold, ring, RING_WORDS, decoded, ring)) {
+        mercury_io_touch_deliver_ring(ring, decoded);
+    }
+
+    ReleaseSRWLockExclusive(&mercury_io_merge_lock);
+}
+
+/* Read timeouts and reconnect attempts: deliver what was folded once the
+   interval has passed, so a release isn't held back while no frames come */
+
+static void mercury_io_touch_flush(void)
+{
+    uint64_t ring[RING_WORDS];
+    int64_t now = mercury_io_qpc();
+
+    AcquireSRWLockExclusive(&mercury_io_merge_lock);
+
+    if (hold_flush(&mercury_io_touch_hold, RING_WORDS, now, ring)) {
+        mercury_io_touch_deliver_ring(ring, now);
+    }
+
+    ReleaseSRWLockExclusive(&mercury_io_merge_lock);
+}
+
+static unsigned int __stdcall mercury_io_touch_thread_proc(void *ctx)
+{
+    struct mercury_io_board *board = ctx;
+    static const uint8_t idle[30];
+    uint8_t cells[30];
     slider_packet_t reponse;
-	BOOL ESC = FALSE;
-    package_init(&reponse);	
+
+    // 双板时每块板的帧可以只有自己的15字节，也可以是完整的30字节（只取自己的一半）
+    package_init(&reponse);
     while (1) {
-        switch (serial_read_cmd(&reponse)) {
+        switch (slider_port_read_cmd(&board->port, &reponse)) {
 		    case SLIDER_CMD_AUTO_SCAN:
-			    memcpy(cell_raw, reponse.cell, 30);
-                package_init(&reponse);
-                for(uint8_t i = 0;i<30;i++){
-                    for(uint8_t y=0;y<8;y++){
-                        if(cell_raw[i] & (1 << y)){
-                            cellPressed[i*8+y] = true;
-                        }else{
-                            cellPressed[i*8+y] = false;
-                        }
+                if(mercury_io_board_count == 2 && reponse.size == 16){
+                    memcpy(&cells[board->index * 15], reponse.cell, 15);
+                    if(board->index == 0){
+                        mercury_io_board_status(reponse.cell[15]);
+                    }
+                }else if(mercury_io_board_count == 2 && reponse.size == 15){
+                    memcpy(&cells[board->index * 15], reponse.cell, 15);
+                }else{
+                    memcpy(cells, reponse.cell, 30);
+                    if(reponse.size >= 31 && board->index == 0){
+                        //新固件在触摸数据后跟随一位测试/服务/投币/音量键
+                        mercury_io_board_status(reponse.io_status);
                     }
                 }
-                callback(cellPressed);
+                package_init(&reponse);
+                mercury_io_touch_publish(board, cells, mercury_io_qpc(), false);
 			    break;
             case 0xff:
-                for(uint8_t i=0;i<240;i++){
-                    cellPressed[i] = false;
+                if(board->index == 0){
+                    mercury_io_board_status(0);
                 }
-                callback(cellPressed);
-                close_port();
-                while(!open_port()){
-                    close_port();
-                    	// Open ports
-                    strncpy(comPort,GetSerialPortByVidPid(vid,pid),6);
-                    if(comPort[0] == 0){
-                        int port_num = 20;
-                        snprintf(comPort, 10, "\\\\.\\COM%d", port_num);
-                    }else if(comPort[4] == 0){
-                    }else if(comPort[5] == 0){
-                        int port_num = (comPort[3]-48)*10 + (comPort[4]-48);
-                        snprintf(comPort, 10, "\\\\.\\COM%d", port_num);
-                    }else{
-                        int port_num = (comPort[3]-48)*100 + (comPort[4]-48)*10 + (comPort[5]-48);
-                        snprintf(comPort, 11, "\\\\.\\COM%d", port_num);
-                        
-                    }
-                    open_port();
-                    //memset(pressure,0, 32);
-                    callback(cellPressed);
-                    Sleep(1);
+                // 断开时只发布一次松开，重连期间不再调用游戏
+                mercury_io_touch_publish(board, idle, mercury_io_qpc(), true);
+                slider_port_close(&board->port);
+                while(!slider_port_open(&board->port)){
+                    slider_port_close(&board->port);
+                    Sleep(MERCURY_IO_RECONNECT_INTERVAL);
+                    mercury_io_touch_flush();
+                    mercury_io_board_find(board);
                 }
                 Sleep(1);
-                slider_start_scan();
-                callback(cellPressed);
+                slider_port_start_scan(&board->port);
                 break;
             case 0xfe:
-                //printf("fe\n");
+                mercury_io_touch_flush();
                 break;
             default:
-                // for(uint8_t i=0;i<240;i++){
-                //     cellPressed[i] = false;
-                // }
-                // callback(cellPressed);
                 break;
         }
     }
@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "cadence.h"
+
 struct led_data {
    DWORD unitCount;
    uint8_t rgba[480 * 4];
@@ -72,3 +74,63 @@ HRESULT mercury_io_touch_init(void);
 void mercury_io_touch_start(mercury_io_touch_callback_t callback);
 
 void mercury_io_touch_set_leds(struct led_data data);
+
+/* Extended exports. These are not part of the segatools API and are never
+   called by the game; hooks and tools can find them with GetProcAddress.
+
+   The board doesn't timestamp its frames, so device_qpc is the
+   QueryPerformanceCounter value taken as soon as the frame was decoded, and
+   host_qpc the value right before it was handed to the game callback. */
+
+struct mercury_io_ext_touch {
+    uint32_t seq;       /* Frames so far, 0 before the first one */
+    uint8_t cells[30];  /* Bit b of cells[n] is cell n * 8 + b of the callback state */
+    int64_t device_qpc;
+    int64_t host_qpc;
+};
+
+/* Copy the latest touch frame. Returns false if none has arrived yet. */
+
+bool mercury_io_ext_get_touch(struct mercury_io_ext_touch *out);
+
+/* Dual board merging ([touch] dualBoard=1). Every half-frame produces a
+   merged callback with the latest frame of the other half. skew is a log2
+   histogram (see cadence.h) of how much older that other half was; stale
+   counts callbacks where it was older than [touch] staleLimit ms and was
+   released instead. All zero with a single board. */
+
+struct mercury_io_ext_merge {
+    volatile LONG frames[2];
+    volatile LONG stale;
+    volatile LONG max_skew_us;
+    volatile LONG skew[CADENCE_BUCKETS];
+};
+
+bool mercury_io_ext_get_merge(struct mercury_io_ext_merge *out);
+
+/* Noise filter ([touch] noiseFilter=1, see ringfilter.h). suppressed counts
+   the cells held back, per sector (side * 30 + column). */
+
+struct mercury_io_ext_noise {
+    volatile LONG frames;
+    volatile LONG suppressed[60];
+};
+
+bool mercury_io_ext_get_noise(struct mercury_io_ext_noise *out);
+
+/* Call cadence of the game-facing entry points (see cadence.h). The touch
+   callback is timed around the call into the game. Gaps longer than
+   [cadence] gapThreshold ms are counted in gaps. */
+
+enum {
+    MERCURY_IO_API_POLL = 0,
+    MERCURY_IO_API_GET_OPBTNS = 1,
+    MERCURY_IO_API_GET_GAMEBTNS = 2,
+    MERCURY_IO_API_TOUCH_SET_LEDS = 3,
+    MERCURY_IO_API_TOUCH_CALLBACK = 4,
+    MERCURY_IO_API_COUNT = 5,
+};
+
+/* Copy the stats of one API. Returns false if api is out of range. */
+
+bool mercury_io_ext_get_cadence(uint8_t api, struct cadence_stats *out);
@@ -0,0 +1,107 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "ringfilter.h"
+
+/* Cells in column 0 / column 29 of their run, and in the top / bottom row
+   of their side. Shifting the ring would otherwise make the last cell of a
+   run a neighbour of the first cell of the next one. */
+static uint64_t ring_first_col[RING_WORDS];
+static uint64_t ring_last_col[RING_WORDS];
+static uint64_t ring_first_row[RING_WORDS];
+static uint64_t ring_last_row[RING_WORDS];
+static int ring_masks_ready;
+
+static void ring_set(uint64_t ring[RING_WORDS], int cell)
+{
+    ring[cell / 64] |= (uint64_t) 1 << (cell % 64);
+}
+
+static void ring_masks_init(void)
+{
+    int i;
+
+    for (i = 0; i < RING_CELLS; i++) {
+        if (i % 30 == 0) {
+            ring_set(ring_first_col, i);
+        }
+        if (i % 30 == 29) {
+            ring_set(ring_last_col, i);
+        }
+        if ((i / 30) % 4 == 0) {
+            ring_set(ring_first_row, i);
+        }
+        if ((i / 30) % 4 == 3) {
+            ring_set(ring_last_row, i);
+        }
+    }
+
+    ring_masks_ready = 1;
+}
+
+/* out = in << n (towards higher cells), 0 < n < 64 */
+
+static inline void ring_shl(uint64_t out[RING_WORDS], const uint64_t in[RING_WORDS], int n)
+{
+    out[3] = (in[3] << n) | (in[2] >> (64 - n));
+    out[2] = (in[2] << n) | (in[1] >> (64 - n));
+    out[1] = (in[1] << n) | (in[0] >> (64 - n));
+    out[0] = in[0] << n;
+}
+
+static inline void ring_shr(uint64_t out[RING_WORDS], const uint64_t in[RING_WORDS], int n)
+{
+    out[0] = (in[0] >> n) | (in[1] << (64 - n));
+    out[1] = (in[1] >> n) | (in[2] << (64 - n));
+    out[2] = (in[2] >> n) | (in[3] << (64 - n));
+    out[3] = in[3] >> n;
+}
+
+void ring_filter_reset(struct ring_filter *f)
+{
+    memset(f, 0, sizeof(*f));
+}
+
+void ring_from_cells(uint64_t ring[RING_WORDS], const uint8_t cells[30])
+{
+    memset(ring, 0, RING_WORDS * sizeof(uint64_t));
+    memcpy(ring, cells, 30);
+}
+
+void ring_to_cells(uint8_t cells[30], const uint64_t ring[RING_WORDS])
+{
+    memcpy(cells, ring, 30);
+}
+
+void ring_filter_apply(struct ring_filter *f, uint64_t ring[RING_WORDS], uint64_t suppressed[RING_WORDS])
+{
+    uint64_t left[RING_WORDS];
+    uint64_t right[RING_WORDS];
+    uint64_t up[RING_WORDS];
+    uint64_t down[RING_WORDS];
+    uint64_t keep;
+    int i;
+
+    if (!ring_masks_ready) {
+        ring_masks_init();
+    }
+
+    /* Shift copies of the frame so that each cell lines up with one of its
+       neighbours; the masks drop the cells that have no such neighbour. */
+    ring_shl(left, ring, 1);
+    ring_shr(right, ring, 1);
+    ring_shl(up, ring, 30);
+    ring_shr(down, ring, 30);
+
+    for (i = 0; i < RING_WORDS; i++) {
+        keep = f->prev[i]
+                | (left[i] & ~ring_first_col[i])
+                | (right[i] & ~ring_last_col[i])
+                | (up[i] & ~ring_first_row[i])
+                | (down[i] & ~ring_last_row[i]);
+
+        f->prev[i] = ring[i];
+        suppressed[i] = ring[i] & ~keep;
+        ring[i] &= keep;
+    }
+}
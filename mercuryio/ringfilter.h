@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Noise filter for the 240-cell ring.
+
+   The ring is held as four 64-bit words, bit n of the ring being cell n of
+   the touch callback (bit b of cells[n / 8] is cell n / 8 * 8 + b). Cells
+   come in eight runs of 30: runs 0-3 are the four rows of one side and runs
+   4-7 of the other, and within a run neighbouring cells are neighbouring
+   columns. A cell's neighbours are the cells next to it in its run and the
+   cells in the same column of the rows above and below on the same side.
+
+   A cell that lights up alone (no active neighbour on this frame) and
+   wasn't active on the previous frame is held back for one frame. If it is
+   still active on the next frame it passes then, so a real tap is delayed
+   by one frame only when it touches a single cell, and a tap that covers
+   two cells isn't delayed at all. A one-frame blip never reaches the game. */
+
+#define RING_WORDS 4
+#define RING_CELLS 240
+#define RING_SECTORS 60 /* Columns of both sides, side * 30 + column */
+
+struct ring_filter {
+    uint64_t prev[RING_WORDS];  /* Unfiltered previous frame */
+};
+
+void ring_filter_reset(struct ring_filter *f);
+
+void ring_from_cells(uint64_t ring[RING_WORDS], const uint8_t cells[30]);
+void ring_to_cells(uint8_t cells[30], const uint64_t ring[RING_WORDS]);
+
+/* Filter one frame in place. The cells that were held back are returned in
+   suppressed. */
+
+void ring_filter_apply(struct ring_filter *f, uint64_t ring[RING_WORDS], uint64_t suppressed[RING_WORDS]);
+
+/* Sector (0-59) of a cell */
+
+static inline int ring_sector(int cell)
+{
+    return (cell / 120) * 30 + cell % 30;
+}
@@ -5,14 +5,14 @@
 #include <conio.h>
 #include <SetupAPI.h>
 
-#define READ_BUF_SIZE 256
 #define READ_TIMEOUT 500
 
 #pragma comment(lib, "setupapi.lib")
 
 char comPort[13] = {0};
 
-const char* GetSerialPortByVidPid(const char* vid, const char* pid) {
+// 返回第index个（从0开始）匹配VID/PID的设备的串口名，如"COM5"，没有则返回空字符串
+const char* GetSerialPortByVidPidIndex(const char* vid, const char* pid, int index) {
     HDEVINFO deviceInfoSet;
     SP_DEVINFO_DATA deviceInfoData;
     DWORD i;
@@ -40,8 +40,11 @@ const char* GetSerialPortByVidPid(const char* vid, const char* pid) {
                     DWORD portNameSize = sizeof(portName);
                     if (RegQueryValueEx(hDeviceKey, "PortName", NULL, NULL, (LPBYTE)portName, &portNameSize) == ERROR_SUCCESS) {
                         RegCloseKey(hDeviceKey);
-                        SetupDiDestroyDeviceInfoList(deviceInfoSet);
-                        return portName;
+                        if (index-- == 0) {
+                            SetupDiDestroyDeviceInfoList(deviceInfoSet);
+                            return portName;
+                        }
+                        continue;
                     }
                     RegCloseKey(hDeviceKey);
                 }
@@ -53,53 +56,105 @@ const char* GetSerialPortByVidPid(const char* vid, const char* pid) {
     return zero;
 }
 
+const char* GetSerialPortByVidPid(const char* vid, const char* pid) {
+    return GetSerialPortByVidPidIndex(vid, pid, 0);
+}
+
 // Global state
-HANDLE hPort; // 串口句柄
 DCB dcb; // 串口参数结构体
 COMMTIMEOUTS timeouts; // 串口超时结构体
-OVERLAPPED ovWrite;
-BOOL fWaitingOnRead = FALSE, fWaitingOnWrite = FALSE;
 slider_packet_t request;
 BOOL Serial_Status;//串口状态（是否成功打开）
 
+// 串口以重叠I/O方式打开，读和写各自独立进行：
+// 游戏线程发送灯光数据时不再需要等待读取线程正在进行的ReadFile返回
+static slider_port_t default_port = { INVALID_HANDLE_VALUE, {0}, {0}, {0}, SRWLOCK_INIT };
+HANDLE hPort = INVALID_HANDLE_VALUE; // 默认串口句柄
+
+void slider_port_init(slider_port_t *port){
+	memset(port, 0, sizeof(*port));
+	port->handle = INVALID_HANDLE_VALUE;
+	InitializeSRWLock(&port->write_lock);
+}
+
+// 按VID/PID查找串口并把名称写入port->name，找不到时返回FALSE且不修改名称
+BOOL slider_port_find(slider_port_t *port, const char* vid, const char* pid, int index){
+	const char *name = GetSerialPortByVidPidIndex(vid, pid, index);
+	if(name[0] == 0){
+		return FALSE;
+	}
+	snprintf(port->name, sizeof(port->name), "\\\\.\\%s", name);
+	return TRUE;
+}
+
+// 串口驱动参数，默认值对应Affine的CDC板子：
+// 有数据立即返回、没有数据最多等待5毫秒，关闭RTS和CTS流控，DTR保持驱动默认
+static struct serial_tune slider_tune = {
+	.in_queue = 4096,
+	.out_queue = 4096,
+	.read_interval = MAXDWORD,
+	.read_constant = 5,
+	.read_multiplier = MAXDWORD,
+	.write_constant = 100,
+	.write_multiplier = 10,
+	.dtr = SERIAL_TUNE_KEEP,
+	.rts = RTS_CONTROL_DISABLE,
+	.cts_flow = 0,
+	.dsr_flow = SERIAL_TUNE_KEEP,
+	.latency_timer = 0,
+};
+
+// 只在串口关闭时调用，下次打开串口时生效
+void slider_set_tune(const struct serial_tune *tune){
+	slider_tune = *tune;
+}
+
+void slider_get_tune(struct serial_tune *tune){
+	*tune = slider_tune;
+}
+
 // Windows Serial helpers
-BOOL open_port()
+BOOL slider_port_open(slider_port_t *port)
 {
     // 打开串口
-    hPort = CreateFile(comPort, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
-    if (hPort == INVALID_HANDLE_VALUE)
+    port->handle = CreateFile(port->name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+    if (port->handle == INVALID_HANDLE_VALUE)
     {
-        //printf("can't open %s!\n", comPort);
+        //printf("can't open %s!\n", port->name);
         return FALSE;
     }
 
-    // 获取串口参数
-    GetCommState(hPort, &dcb);
-    // 设置串口参数
-    dcb.BaudRate = 115200; // 设置波特率
-    dcb.ByteSize = 8; // 设置数据位为8
-    dcb.Parity = NOPARITY; // 设置无奇偶校验
-    dcb.StopBits = ONESTOPBIT; // 设置停止位为1
-	dcb.fRtsControl = RTS_CONTROL_DISABLE;
-	dcb.fOutxCtsFlow = FALSE;
-    SetCommState(hPort, &dcb);
-
-    // 获取串口超时
-    GetCommTimeouts(hPort, &timeouts);
-
-    // 设置串口超时
-    
-	timeouts.ReadIntervalTimeout = 1; // 设置读取间隔超时为1毫秒
-    timeouts.ReadTotalTimeoutConstant = 5; // 设置读取总超时常量为5毫秒
-    timeouts.ReadTotalTimeoutMultiplier = 1; // 设置读取总超时乘数为1毫秒
-    timeouts.WriteTotalTimeoutConstant = 100; // 设置写入总超时常量为100毫秒
-    timeouts.WriteTotalTimeoutMultiplier = 10; // 设置写入总超时乘数为10毫秒
-    SetCommTimeouts(hPort, &timeouts);
+    // 队列大小、DTR/RTS、流控和超时按设备配置设置（见serialtune.h）
+    serial_tune_apply(port->handle, &slider_tune);
+
+    if (port->ovRead.hEvent == NULL) {
+        port->ovRead.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    }
+    if (port->ovWrite.hEvent == NULL) {
+        port->ovWrite.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    }
+    port->read_pos = port->read_len = 0;
+    return TRUE;
+}
+
+void slider_port_close(slider_port_t *port){
+	CloseHandle(port->handle);
+	port->handle = INVALID_HANDLE_VALUE;
+	port->read_pos = port->read_len = 0;
+}
+
+BOOL open_port()
+{
+    memcpy(default_port.name, comPort, sizeof(comPort));
+    if (!slider_port_open(&default_port)) {
+        return FALSE;
+    }
+    hPort = default_port.handle;
     return TRUE;
 }
 
 void close_port(){
-	CloseHandle(hPort);
+	slider_port_close(&default_port);
 	hPort = INVALID_HANDLE_VALUE;
 }
 
@@ -122,32 +177,30 @@ void package_init(slider_packet_t *request){
 	}
 }
 
-BOOL send_data(int length,uint8_t *send_buffer)
+static BOOL slider_port_send(slider_port_t *port, int length, uint8_t *send_buffer)
 {
     DWORD bytes_written; // 写入的字节数
-	// while (fWaitingOnWrite) {
-    //     // Already waiting for a write to complete.
-    // }
-    // // Write data to the port asynchronously.
-    // fWaitingOnWrite = TRUE;
-    // 写入数据
-    if (!WriteFile(hPort, send_buffer, length, &bytes_written, NULL))
-    {
-        // printf("can't write data to");
-		// printf(comPort);
-		// printf("/n");
-        return FALSE;
-    }
-    // 返回成功
-	//WriteFile(hPort, send_buffer, length, &bytes_written, &ovWrite);
-    return TRUE;
+    BOOL result;
+
+    AcquireSRWLockExclusive(&port->write_lock);
+    // 重叠写入，与读取线程的ReadFile互不阻塞；这里等待写入完成后再返回
+    result = WriteFile(port->handle, send_buffer, length, NULL, &port->ovWrite) || GetLastError() == ERROR_IO_PENDING;
+    result = result && GetOverlappedResult(port->handle, &port->ovWrite, &bytes_written, TRUE);
+    ReleaseSRWLockExclusive(&port->write_lock);
+
+    return result;
+}
+
+BOOL send_data(int length,uint8_t *send_buffer)
+{
+    return slider_port_send(&default_port, length, send_buffer);
 }
 
 static uint32_t millis() {
 	return GetTickCount();
 }
 
-void sliderserial_writeresp(slider_packet_t *request) {
+static void slider_port_writeresp(slider_port_t *port, slider_packet_t *request) {
 	uint8_t checksum = 0 - request->syn - request->cmd - request->size; 
 	uint8_t length = request->size + 4;
 	for (uint8_t i = 0;i<request->size;i++){
@@ -162,29 +215,47 @@ void sliderserial_writeresp(slider_packet_t *request) {
 	// 	request.checksum[1] = 0xfe;
 	// 	uint8_t length = request.size + 4;
 	// }
-	send_data(length,request->data);
+	slider_port_send(port, length, request->data);
 }
 
-BOOL serial_read1(uint8_t *result){
-	long unsigned int recv_len;
-	if (ReadFile(hPort,  result, 1, &recv_len, NULL) && (recv_len != 0)){
+void sliderserial_writeresp(slider_packet_t *request) {
+	slider_port_writeresp(&default_port, request);
+}
+
+// 一次读取缓冲区中所有可用数据，再逐字节交给解析
+static BOOL slider_port_read1(slider_port_t *port, uint8_t *result){
+	DWORD recv_len;
+	if (port->read_pos < port->read_len){
+		*result = port->read_buf[port->read_pos++];
 		return TRUE;
 	}
-	else{
-		return false;
+	if (!ReadFile(port->handle, port->read_buf, READ_BUF_SIZE, NULL, &port->ovRead) && GetLastError() != ERROR_IO_PENDING){
+		return FALSE;
 	}
-	
+	if (!GetOverlappedResult(port->handle, &port->ovRead, &recv_len, TRUE) || (recv_len == 0)){
+		return FALSE;
+	}
+	port->read_pos = 1;
+	port->read_len = recv_len;
+	*result = port->read_buf[0];
+	return TRUE;
 }
 
-uint8_t serial_read_cmd(slider_packet_t *reponse){
+BOOL serial_read1(uint8_t *result){
+	return slider_port_read1(&default_port, result);
+}
+
+uint8_t slider_port_read_cmd(slider_port_t *port, slider_packet_t *reponse){
+	DCB port_dcb;
 	uint8_t checksum = 0;
 	uint8_t rep_size = 0;
 	BOOL ESC = FALSE;
 	uint8_t c;
 	COMSTAT comStat;
 	DWORD   dwErrors = 0;
-	PurgeComm(hPort, PURGE_RXCLEAR);
-	while(serial_read1(&c)){
+	PurgeComm(port->handle, PURGE_RXCLEAR);
+	port->read_pos = port->read_len = 0;
+	while(slider_port_read1(port, &c)){
 		if(c == 0xff){
 			package_init(reponse);
 			rep_size = 0;
@@ -222,7 +293,7 @@ uint8_t serial_read_cmd(slider_packet_t *reponse){
 		}
 		rep_size++;
 	}
-	if (!GetCommState(hPort, &dcb)) {
+	if (!GetCommState(port->handle, &port_dcb)) {
     // 串口已断开
 	//printf("rff/n");
 		return 0xff;
@@ -231,6 +302,10 @@ uint8_t serial_read_cmd(slider_packet_t *reponse){
 	return 0xfe;
 }
 
+uint8_t serial_read_cmd(slider_packet_t *reponse){
+	return slider_port_read_cmd(&default_port, reponse);
+}
+
 void slider_rst(){
 	package_init(&request);
 	request.syn = 0xff;
@@ -249,6 +324,16 @@ void slider_start_scan(){
 	Sleep(1);
 }
 
+void slider_port_start_scan(slider_port_t *port){
+	slider_packet_t scan;
+	package_init(&scan);
+	scan.syn = 0xff;
+	scan.cmd = SLIDER_CMD_AUTO_SCAN_START;
+	scan.size = 0;
+	slider_port_writeresp(port, &scan);
+	Sleep(1);
+}
+
 void slider_stop_scan(){
 	package_init(&request);
 	request.syn = 0xff;
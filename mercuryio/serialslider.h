@@ -9,8 +9,10 @@
 #include <conio.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include "serialtune.h"
 
 #define BUFSIZE 128
+#define READ_BUF_SIZE 256
 #define CMD_TIMEOUT 3000
 
 typedef enum slider_cmd {
@@ -33,14 +35,39 @@ typedef union slider_packet {
 				uint8_t board_no;
 				uint8_t leds[60];
 			};
-			uint8_t cell[30];
+			struct{
+				uint8_t cell[30];
+				uint8_t io_status; // 新固件：测试/服务/投币/音量键
+			};
 		};
 	};
 	uint8_t data[BUFSIZE];
 } slider_packet_t;
 
 
+// 一个串口的全部状态。双板时每块板各用一个，两个读取线程互不干扰；
+// 旧接口（open_port/serial_read_cmd等）操作名称为comPort的默认串口
+typedef struct slider_port {
+	HANDLE handle;
+	char name[16];
+	OVERLAPPED ovRead;
+	OVERLAPPED ovWrite;
+	SRWLOCK write_lock; // 多个线程都可能发送数据，ovWrite同一时间只能有一个写操作使用
+	uint8_t read_buf[READ_BUF_SIZE];
+	DWORD read_pos;
+	DWORD read_len;
+} slider_port_t;
+
 const char* GetSerialPortByVidPid(const char* vid, const char* pid);
+const char* GetSerialPortByVidPidIndex(const char* vid, const char* pid, int index);
+void slider_set_tune(const struct serial_tune *tune);
+void slider_get_tune(struct serial_tune *tune);
+void slider_port_init(slider_port_t *port);
+BOOL slider_port_find(slider_port_t *port, const char* vid, const char* pid, int index);
+BOOL slider_port_open(slider_port_t *port);
+void slider_port_close(slider_port_t *port);
+uint8_t slider_port_read_cmd(slider_port_t *port, slider_packet_t *reponse);
+void slider_port_start_scan(slider_port_t *port);
 BOOL open_port();
 void close_port();
 BOOL IsSerialPortOpen();